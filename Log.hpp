@@ -4,6 +4,8 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <ctime>
+#include <time.h>
+#include <stdint.h>
 #include <stdarg.h>
 #include <fstream>
 #include <cstring>
@@ -42,20 +44,97 @@ namespace log_ns
         }
     }
 
-    // 获取当前时间的字符串表示
+    // 按线程缓存的时钟：EventLoop 每轮事件循环读取一次单调时钟和系统时钟，同一轮中的定时器、日志等直接使用缓存的值
+    // 格式化的时间字符串按秒缓存，秒数变化时才重新调用 localtime_r
+    class CachedClock
+    {
+    private:
+        bool _caching;          // 是否使用缓存的时间，EventLoop 运行期间为 true，否则每次访问都重新读取时钟
+        uint64_t _monotonic_ms; // 单调时钟，单位为毫秒
+        time_t _wall_sec;       // 系统时钟，单位为秒
+        time_t _formatted_sec;  // _formatted 对应的系统时钟秒数
+        char _formatted[128];   // 格式化的当前时间，格式为 年-月-日 时:分:秒
+
+    public:
+        CachedClock() : _caching(false), _monotonic_ms(0), _wall_sec(0), _formatted_sec(-1)
+        {
+            _formatted[0] = '\0';
+            Update();
+        }
+
+        // 当前线程的 EventLoop 所使用的时钟，不是 EventLoop 线程时为 NULL
+        static CachedClock *&Current()
+        {
+            static thread_local CachedClock *clock = NULL;
+            return clock;
+        }
+
+        // 重新读取时钟，EventLoop 每轮事件监控返回之后调用一次
+        void Update()
+        {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            _monotonic_ms = (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+            // 系统时钟只需要秒级精度，使用粗粒度时钟
+            clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+            _wall_sec = ts.tv_sec;
+        }
+
+        // 开启或关闭缓存，关闭时每次访问都读取时钟，EventLoop 还没有运行时使用
+        void SetCaching(bool caching)
+        {
+            _caching = caching;
+            Update();
+        }
+
+        // 单调时钟，单位为毫秒
+        uint64_t MonotonicMs()
+        {
+            if (_caching == false)
+                Update();
+            return _monotonic_ms;
+        }
+
+        // 系统时钟，单位为秒
+        time_t WallTime()
+        {
+            if (_caching == false)
+                Update();
+            return _wall_sec;
+        }
+
+        // 格式化的当前时间，同一秒内不重复格式化
+        const char *FormattedTime()
+        {
+            time_t now = WallTime();
+            if (now != _formatted_sec)
+            {
+                struct tm curr_time;
+                localtime_r(&now, &curr_time);
+                snprintf(_formatted, sizeof(_formatted), "%d-%02d-%02d %02d:%02d:%02d",
+                         curr_time.tm_year + 1900, // 年份
+                         curr_time.tm_mon + 1,     // 月份
+                         curr_time.tm_mday,        // 日
+                         curr_time.tm_hour,        // 小时
+                         curr_time.tm_min,         // 分钟
+                         curr_time.tm_sec);        // 秒
+                _formatted_sec = now;
+            }
+            return _formatted;
+        }
+    };
+
+    // 获取当前时间的字符串表示，EventLoop 线程中使用本轮事件循环缓存的时间
     std::string GetCurrTime() // NOLINT
     {
-        time_t now = time(nullptr);
-        struct tm *curr_time = localtime(&now);
-        char buffer[128];
-        snprintf(buffer, sizeof(buffer), "%d-%02d-%02d %02d:%02d:%02d",
-                 curr_time->tm_year + 1900, // 年份
-                 curr_time->tm_mon + 1,     // 月份
-                 curr_time->tm_mday,        // 日
-                 curr_time->tm_hour,        // 小时
-                 curr_time->tm_min,         // 分钟
-                 curr_time->tm_sec);        // 秒
-        return buffer;
+        CachedClock *clock = CachedClock::Current();
+        if (clock == NULL)
+        {
+            // 其他线程使用自己的时钟，不缓存时间，但同一秒内仍然不重复格式化
+            static thread_local CachedClock local;
+            clock = &local;
+        }
+        return clock->FormattedTime();
     }
 
     // 日志消息类，用于存储日志的各个部分
@@ -0,0 +1,273 @@
+#pragma once
+#include "Util.hpp"
+#include <list>
+#include <mutex>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <sys/resource.h>
+
+// 默认最多缓存的文件数量上限，实际容量还受进程可打开文件数的限制，见 DefaultCapacity
+#define DEFAULT_FILE_CACHE_CAPACITY 1024
+// 默认最多记录的不存在路径数量，这些条目不占用文件描述符，单独存放，不会挤掉缓存的文件
+#define DEFAULT_FILE_CACHE_MISSING 4096
+// 默认缓存条目的有效期，单位为毫秒，过期后重新打开文件、获取文件信息
+#define DEFAULT_FILE_CACHE_TTL 1000
+// 缓存分片数量，每个分片有自己的锁，减少多个 EventLoop 线程之间的锁竞争
+#define FILE_CACHE_SHARDS 16
+
+// 文件缓存条目，保存一个静态资源文件打开的描述符以及元信息
+class FileEntry
+{
+public:
+    std::string _path;  // 规范化之后的文件路径，作为缓存的键
+    PtrFile _file;      // 打开的文件，为空表示该路径不是一个可以访问的普通文件
+    uint64_t _size;     // 文件大小
+    std::string _mime;  // 预先计算好的文件 MIME 类型
+    uint64_t _expire;   // 缓存条目的过期时间，单位为毫秒
+
+public:
+    FileEntry() : _size(0), _expire(0) {}
+
+    // 判断该路径是否是一个可以访问的普通文件
+    bool Exists() const { return (bool)_file; }
+};
+
+// 定义一个智能指针类型，缓存条目是只读的，可以被多个线程同时使用
+using PtrFileEntry = std::shared_ptr<const FileEntry>;
+
+// 静态资源文件缓存类，按规范化路径缓存打开的文件描述符、文件大小和 MIME 类型
+// 热点文件命中缓存后不再需要任何 stat/open 系统调用；缓存条目数量有上限，超出时淘汰最久未使用的条目
+// 缓存条目在有效期过后失效，下一次访问时重新打开文件，这样文件被修改、删除后最多在一个有效期内生效
+// 不存在的路径（包括交给路由处理的动态路径）记录在单独的有界表中，既避免反复 open，也不会淘汰缓存的文件
+class FileCache
+{
+private:
+    using EntryList = std::list<PtrFileEntry>;
+    // 缓存分片，按路径的哈希值选择分片，每个分片独立加锁
+    struct Shard
+    {
+        // 互斥锁，只保护本分片的数据
+        std::mutex _mutex;
+        // 缓存条目链表，按使用时间排列，表头是最近使用的条目
+        EntryList _lru;
+        // 路径到链表节点的映射，用于快速查找
+        std::unordered_map<std::string, EntryList::iterator> _index;
+        // 不存在的路径到过期时间的映射，不占用文件描述符
+        std::unordered_map<std::string, uint64_t> _missing;
+    };
+    Shard _shards[FILE_CACHE_SHARDS];
+    // 以下配置不属于任何分片，使用原子变量，运行中调用 SetLimit 也不会与查找产生数据竞争
+    // 每个分片最多缓存的文件数量，为 0 表示不缓存
+    std::atomic<size_t> _capacity;
+    // 每个分片最多记录的不存在路径数量
+    std::atomic<size_t> _missing_capacity;
+    // 缓存条目的有效期，单位为毫秒
+    std::atomic<uint64_t> _ttl;
+
+private:
+    // 获取当前的单调时间，单位为毫秒；使用粗粒度时钟，在 vDSO 中完成，不会陷入内核
+    static uint64_t NowMs()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    }
+
+    // 默认缓存的文件数量：不超过可打开文件数的四分之一，给监听套接字接收新连接留出足够的描述符
+    static size_t DefaultCapacity()
+    {
+        struct rlimit rl;
+        if (getrlimit(RLIMIT_NOFILE, &rl) < 0 || rl.rlim_cur == RLIM_INFINITY)
+        {
+            return DEFAULT_FILE_CACHE_CAPACITY;
+        }
+        return std::min((size_t)DEFAULT_FILE_CACHE_CAPACITY, (size_t)(rl.rlim_cur / 4));
+    }
+
+    // 总数量平均分到每个分片，向上取整，总数不为 0 时每个分片至少一个
+    static size_t PerShard(size_t total)
+    {
+        return (total + FILE_CACHE_SHARDS - 1) / FILE_CACHE_SHARDS;
+    }
+
+    Shard &GetShard(const std::string &key)
+    {
+        return _shards[std::hash<std::string>()(key) % FILE_CACHE_SHARDS];
+    }
+
+    // 超出容量，淘汰分片中最久未使用的条目，调用前需持有分片的锁
+    void Evict(Shard &shard)
+    {
+        while (shard._lru.size() > _capacity)
+        {
+            shard._index.erase(shard._lru.back()->_path);
+            shard._lru.pop_back();
+        }
+    }
+
+    // 记录一个不存在的路径，调用前需持有分片的锁
+    // 表满时先清掉已过期的记录，仍然满就整体清空，保证表的大小有上限
+    void AddMissing(Shard &shard, const std::string &key, uint64_t expire)
+    {
+        if (_missing_capacity == 0)
+        {
+            return;
+        }
+        if (shard._missing.size() >= _missing_capacity)
+        {
+            uint64_t now = NowMs();
+            for (auto it = shard._missing.begin(); it != shard._missing.end();)
+            {
+                if (it->second <= now)
+                    it = shard._missing.erase(it);
+                else
+                    ++it;
+            }
+            if (shard._missing.size() >= _missing_capacity)
+            {
+                shard._missing.clear();
+            }
+        }
+        shard._missing[key] = expire;
+    }
+
+    // 打开文件并获取文件信息，构造一个新的缓存条目；文件不存在时返回的条目 Exists() 为 false
+    PtrFileEntry Load(const std::string &path)
+    {
+        std::shared_ptr<FileEntry> entry = std::make_shared<FileEntry>();
+        entry->_path = path;
+        entry->_expire = NowMs() + _ttl;
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            return entry;
+        }
+        PtrFile file = std::make_shared<FileHandle>(fd);
+        struct stat st;
+        if (fstat(fd, &st) < 0 || S_ISREG(st.st_mode) == false)
+        {
+            return entry;
+        }
+        entry->_file = file;
+        entry->_size = st.st_size;
+        entry->_mime = Util::ExtMime(path);
+        return entry;
+    }
+
+public:
+    // 构造函数，设置缓存的容量和有效期，容量默认根据进程可打开文件数计算
+    FileCache(size_t capacity = DefaultCapacity(), uint64_t ttl = DEFAULT_FILE_CACHE_TTL)
+        : _capacity(PerShard(capacity)), _missing_capacity(PerShard(DEFAULT_FILE_CACHE_MISSING)), _ttl(ttl) {}
+
+    // 设置缓存的容量和有效期，容量为 0 表示关闭缓存；容量平均分到各个分片，实际总数可能略大于设置值
+    void SetLimit(size_t capacity, uint64_t ttl)
+    {
+        _capacity = PerShard(capacity);
+        _missing_capacity = capacity == 0 ? 0 : PerShard(DEFAULT_FILE_CACHE_MISSING);
+        _ttl = ttl;
+        for (auto &shard : _shards)
+        {
+            std::unique_lock<std::mutex> lock(shard._mutex);
+            Evict(shard);
+            if (_missing_capacity == 0)
+            {
+                shard._missing.clear();
+            }
+        }
+    }
+
+    // 路径规范化，去掉多余的 / 以及 . 和 .. 目录，使同一个文件的不同写法映射到同一个缓存条目
+    // 调用前需确保路径已经通过 Util::ValidPath 检查，不会越过根目录
+    static std::string Normalize(const std::string &path)
+    {
+        std::vector<std::string> subdir;
+        Util::Split(path, "/", &subdir);
+        std::vector<std::string> stack;
+        for (auto &dir : subdir)
+        {
+            if (dir == ".")
+                continue;
+            if (dir == ".." && stack.empty() == false && stack.back() != "..")
+            {
+                stack.pop_back();
+                continue;
+            }
+            stack.push_back(dir);
+        }
+        std::string res = (path.empty() == false && path[0] == '/') ? "/" : "";
+        for (size_t i = 0; i < stack.size(); i++)
+        {
+            if (i > 0)
+                res += "/";
+            res += stack[i];
+        }
+        return res;
+    }
+
+    // 获取路径对应的缓存条目，未命中或者已经过期则重新打开文件
+    PtrFileEntry Get(const std::string &path)
+    {
+        std::string key = Normalize(path);
+        Shard &shard = GetShard(key);
+        {
+            std::unique_lock<std::mutex> lock(shard._mutex);
+            uint64_t now = NowMs();
+            auto it = shard._index.find(key);
+            if (it != shard._index.end())
+            {
+                if ((*it->second)->_expire > now)
+                {
+                    // 命中且未过期，移到表头
+                    shard._lru.splice(shard._lru.begin(), shard._lru, it->second);
+                    return *it->second;
+                }
+                // 已经过期，移除旧条目，正在使用旧条目发送的连接仍然持有旧文件，不受影响
+                shard._lru.erase(it->second);
+                shard._index.erase(it);
+            }
+            auto mit = shard._missing.find(key);
+            if (mit != shard._missing.end())
+            {
+                if (mit->second > now)
+                {
+                    // 最近确认过不存在，直接返回空条目，不再调用 open
+                    std::shared_ptr<FileEntry> entry = std::make_shared<FileEntry>();
+                    entry->_path = key;
+                    entry->_expire = mit->second;
+                    return entry;
+                }
+                shard._missing.erase(mit);
+            }
+        }
+        // 打开文件的系统调用放在锁外进行，不阻塞其他线程的缓存查找
+        PtrFileEntry entry = Load(key);
+        std::unique_lock<std::mutex> lock(shard._mutex);
+        if (entry->Exists() == false)
+        {
+            AddMissing(shard, key, entry->_expire);
+            return entry;
+        }
+        if (_capacity == 0 || shard._index.find(key) != shard._index.end())
+        {
+            // 不缓存，或者其他线程已经抢先加入了该路径的条目
+            return entry;
+        }
+        shard._lru.push_front(entry);
+        shard._index[key] = shard._lru.begin();
+        Evict(shard);
+        return entry;
+    }
+
+    // 清空所有缓存条目
+    void Clear()
+    {
+        for (auto &shard : _shards)
+        {
+            std::unique_lock<std::mutex> lock(shard._mutex);
+            shard._index.clear();
+            shard._lru.clear();
+            shard._missing.clear();
+        }
+    }
+};
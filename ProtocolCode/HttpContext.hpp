@@ -22,6 +22,7 @@ private:
     int _resp_statu;           // 存储 HTTP 响应的状态码，用于在解析过程中出现错误时设置响应状态
     HttpRecvStatu _recv_statu; // 当前 HTTP 请求接收和解析所处的阶段状态
     HttpRequest _request;      // 存储已经解析得到的 HTTP 请求信息
+    bool _busy;                // 上一个请求是否还在计算线程池中处理，处理完之前不解析后续的请求
 
 private:
     // 解析 HTTP 请求的首行
@@ -221,11 +222,12 @@ private:
 
 public:
     // 构造函数，初始化响应状态码为 200，接收状态为接收首行
-    HttpContext() : _resp_statu(200), _recv_statu(RECV_HTTP_LINE) {}
+    HttpContext() : _resp_statu(200), _recv_statu(RECV_HTTP_LINE), _busy(false) {}
 
     // 重置 HttpContext 对象的状态
     void ReSet()
     {
+        // 这里只重置请求的解析状态，_busy 由异步处理的发起和完成来维护
         _resp_statu = 200;
         _recv_statu = RECV_HTTP_LINE;
         _request.ReSet();
@@ -234,6 +236,10 @@ public:
     // 获取响应状态码
     int RespStatu() { return _resp_statu; }
 
+    // 获取/设置是否有请求正在异步处理
+    bool Busy() { return _busy; }
+    void SetBusy(bool busy) { _busy = busy; }
+
     // 获取当前接收状态
     HttpRecvStatu RecvStatu() { return _recv_statu; }
 
@@ -9,14 +9,16 @@ public:
     bool _redirect_flag;  // 表示该响应是否为重定向响应，若为 true 则表示需要重定向
     std::string _body;  // 存储 HTTP 响应的正文内容，例如 HTML 页面、JSON 数据等
     std::string _redirect_url;  // 若为重定向响应，该字段存储重定向的目标 URL
+    PtrFile _file;  // 若正文来自文件，该字段持有打开的文件，发送时通过 sendfile 直接发送，不读入 _body
+    uint64_t _file_size;  // 正文来自文件时，要发送的文件数据长度
     std::unordered_map<std::string, std::string> _headers;  // 存储 HTTP 响应的头部字段，键为头部字段名，值为对应的值
 
 public:
     // 默认构造函数，初始化重定向标志为 false，状态码为 200（OK）
-    HttpResponse() : _redirect_flag(false), _statu(200) {}
+    HttpResponse() : _redirect_flag(false), _statu(200), _file_size(0) {}
 
     // 带参数的构造函数，允许用户指定响应的状态码，重定向标志初始化为 false
-    HttpResponse(int statu) : _redirect_flag(false), _statu(statu) {}
+    HttpResponse(int statu) : _redirect_flag(false), _statu(statu), _file_size(0) {}
 
     // 重置响应对象的所有成员变量，将其恢复到初始状态
     void ReSet()
@@ -26,6 +28,8 @@ public:
         _body.clear();  // 清空响应正文
         _redirect_url.clear();  // 清空重定向 URL
         _headers.clear();  // 清空头部字段
+        _file.reset();  // 释放正文文件
+        _file_size = 0;  // 清空正文文件长度
     }
 
     // 插入一个头部字段到 _headers 中
@@ -63,6 +67,14 @@ public:
         SetHeader("Content-Type", type);  // 设置 Content-Type 头部字段
     }
 
+    // 设置响应的正文为一个文件，文件数据不会读入内存，而是由连接通过 sendfile 直接发送
+    void SetFile(const PtrFile &file, uint64_t size, const std::string &type = "application/octet-stream")
+    {
+        _file = file;  // 持有打开的文件
+        _file_size = size;  // 设置要发送的文件长度
+        SetHeader("Content-Type", type);  // 设置 Content-Type 头部字段
+    }
+
     // 设置重定向信息，指定重定向的目标 URL 和状态码，默认状态码为 302（临时重定向）
     void SetRedirect(const std::string &url, int statu = 302)
     {
@@ -2,6 +2,7 @@
 #include"HttpRequest.hpp"
 #include"HttpResponse.hpp"
 #include"HttpContext.hpp"
+#include"FileCache.hpp"
 
 // 定义HttpServer类，用于处理HTTP请求和响应
 class HttpServer
@@ -9,18 +10,30 @@ class HttpServer
 private:
     // 定义Handler类型，它是一个函数对象，接受一个HttpRequest对象和一个HttpResponse对象的指针作为参数
     using Handler = std::function<void(const HttpRequest &, HttpResponse *)>;
-    // 定义Handlers类型，它是一个存储正则表达式和处理函数对的向量
-    using Handlers = std::vector<std::pair<std::regex, Handler>>;
-    // 存储GET请求的路由表，键为正则表达式，值为处理函数
-    Handlers _get_route;
-    // 存储POST请求的路由表，键为正则表达式，值为处理函数
-    Handlers _post_route;
-    // 存储PUT请求的路由表，键为正则表达式，值为处理函数
-    Handlers _put_route;
-    // 存储DELETE请求的路由表，键为正则表达式，值为处理函数
-    Handlers _delete_route;
+    // 一条路由规则：请求路径的正则表达式、处理函数，以及处理函数是否交给计算线程池执行
+    struct RouteRule
+    {
+        std::regex _re;
+        Handler _handler;
+        bool _offload;
+
+        RouteRule(const std::string &pattern, const Handler &handler, bool offload)
+            : _re(pattern), _handler(handler), _offload(offload) {}
+    };
+    // 定义Routes类型，它是一个存储路由规则的向量
+    using Routes = std::vector<RouteRule>;
+    // 存储GET请求的路由表
+    Routes _get_route;
+    // 存储POST请求的路由表
+    Routes _post_route;
+    // 存储PUT请求的路由表
+    Routes _put_route;
+    // 存储DELETE请求的路由表
+    Routes _delete_route;
     // 静态资源的根目录，用于处理静态资源请求
     std::string _basedir; 
+    // 静态资源文件缓存，缓存打开的文件描述符和元信息，热点文件无需任何元数据系统调用
+    FileCache _file_cache;
     // 底层的TCP服务器对象，用于处理网络连接
     TcpServer _server;
 
@@ -65,6 +78,11 @@ private:
             // 长连接则设置Connection头部为keep-alive
             rsp.SetHeader("Connection", "keep-alive");
         }
+        // 如果响应正文来自文件，Content-Length为文件数据的长度
+        if (rsp._file && rsp.HasHeader("Content-Length") == false)
+        {
+            rsp.SetHeader("Content-Length", std::to_string(rsp._file_size));
+        }
         // 如果响应正文不为空且没有设置Content-Length头部
         if (rsp._body.empty() == false && rsp.HasHeader("Content-Length") == false)
         {
@@ -84,24 +102,28 @@ private:
             rsp.SetHeader("Location", rsp._redirect_url);
         }
         // 2. 将rsp中的要素，按照http协议格式进行组织
-        std::stringstream rsp_str;
+        std::string rsp_head;
         // 构建响应行，包含协议版本、状态码和状态描述
-        rsp_str << req._version << " " << std::to_string(rsp._statu) << " " << Util::StatuDesc(rsp._statu) << "\r\n";
+        rsp_head += req._version + " " + std::to_string(rsp._statu) + " " + Util::StatuDesc(rsp._statu) + "\r\n";
         // 遍历响应头部，将每个头部字段添加到响应字符串中
         for (auto &head : rsp._headers)
         {
-            rsp_str << head.first << ": " << head.second << "\r\n";
+            rsp_head += head.first + ": " + head.second + "\r\n";
         }
         // 头部和正文之间的空行
-        rsp_str << "\r\n";
-        // 添加响应正文
-        rsp_str << rsp._body;
+        rsp_head += "\r\n";
         // 3. 发送数据
-        // 将组织好的响应字符串发送给客户端
-        conn->Send(rsp_str.str().c_str(), rsp_str.str().size());
+        // 头部和正文分别作为独立的数据块移交给连接，由连接一次sendmsg发出，既不拼接也不拷贝
+        conn->Send(std::move(rsp_head));
+        conn->Send(std::move(rsp._body));
+        if (rsp._file)
+        {
+            // 文件正文排在头部之后，由连接通过sendfile直接发送
+            conn->SendFile(rsp._file, 0, rsp._file_size);
+        }
     }
-    // 判断请求是否为静态资源请求
-    bool IsFileHandler(const HttpRequest &req)
+    // 判断请求是否为静态资源请求，是则通过 entry 返回对应文件的缓存条目
+    bool IsFileHandler(const HttpRequest &req, PtrFileEntry *entry)
     {
         // 1. 必须设置了静态资源根目录
         if (_basedir.empty())
@@ -130,102 +152,124 @@ private:
             // 追加index.html
             req_path += "index.html";
         }
+        // 从文件缓存中获取文件信息，命中时不需要任何系统调用，未命中时才打开文件
+        PtrFileEntry file = _file_cache.Get(req_path);
         // 判断请求的资源是否为普通文件
-        if (Util::IsRegular(req_path) == false)
+        if (file->Exists() == false)
         {
             return false;
         }
+        *entry = file;
         return true;
     }
-    // 静态资源的请求处理 --- 将静态资源文件的数据读取出来，放到rsp的_body中, 并设置mime
-    void FileHandler(const HttpRequest &req, HttpResponse *rsp)
+    // 静态资源的请求处理 --- 把缓存中打开的静态资源文件放到rsp中，文件数据由连接通过sendfile直接发送, 并设置mime
+    void FileHandler(HttpResponse *rsp, const PtrFileEntry &entry)
     {
-        // 拼接请求的实际路径
-        std::string req_path = _basedir + req._path;
-        // 如果请求路径以斜杠结尾
-        if (req._path.back() == '/')
-        {
-            // 追加index.html
-            req_path += "index.html";
-        }
-        // 读取文件内容到响应正文中
-        bool ret = Util::ReadFile(req_path, &rsp->_body);
-        if (ret == false)
-        {
-            return;
-        }
-        // 获取文件的MIME类型
-        std::string mime = Util::ExtMime(req_path);
-        // 设置响应的Content-Type头部为文件的MIME类型
-        rsp->SetHeader("Content-Type", mime);
+        // 将文件设置为响应正文，并设置Content-Type头部为预先计算好的MIME类型
+        rsp->SetFile(entry->_file, entry->_size, entry->_mime);
         return;
     }
-    // 功能性请求的分类处理
-    void Dispatcher(HttpRequest &req, HttpResponse *rsp, Handlers &handlers)
+    // 把匹配到的请求交给计算线程池处理，处理完之后在连接所属的线程中发送响应，再继续处理后续的请求
+    void OffloadHandler(const PtrConnection &conn, const HttpRequest &req, const RouteRule &route)
+    {
+        // 请求对象会被重置，复制一份交给计算线程；正则提取的结果指向原请求的路径，需要在副本上重新匹配
+        std::shared_ptr<HttpRequest> preq(new HttpRequest(req));
+        std::shared_ptr<HttpResponse> prsp(new HttpResponse(200));
+        const std::regex *re = &route._re;
+        Handler handler = route._handler;
+        _server.Offload(conn, [preq, prsp, re, handler]()
+                        {
+                            std::regex_match(preq->_path, preq->_matches, *re);
+                            handler(*preq, prsp.get());
+                        },
+                        std::bind(&HttpServer::OnOffloadDone, this, std::placeholders::_1, preq, prsp));
+    }
+    // 计算线程池处理完请求，在连接所属的线程中发送响应
+    void OnOffloadDone(const PtrConnection &conn, const std::shared_ptr<HttpRequest> &req, const std::shared_ptr<HttpResponse> &rsp)
+    {
+        HttpContext *context = conn->GetContext()->get<HttpContext>();
+        context->SetBusy(false);
+        // 处理期间连接可能已经被释放；对端半关闭的连接处于待关闭状态，响应仍然要发送
+        if (conn->Disconnected())
+            return;
+        WriteReponse(conn, *req, *rsp);
+        if (rsp->Close() == true)
+            return conn->Shutdown();
+        // 继续处理处理期间到达的后续请求
+        conn->ResumeMessage();
+    }
+    // 功能性请求的分类处理，请求交给了计算线程池异步处理时返回true，响应稍后发送
+    bool Dispatcher(const PtrConnection &conn, HttpRequest &req, HttpResponse *rsp, Routes &routes)
     {
         // 在对应请求方法的路由表中，查找是否含有对应资源请求的处理函数，有则调用，没有则返回404
         // 思想：路由表存储的时键值对 -- 正则表达式 & 处理函数
         // 使用正则表达式，对请求的资源路径进行正则匹配，匹配成功就使用对应函数进行处理
         //   /numbers/(\d+)       /numbers/12345
         // 遍历路由表
-        for (auto &handler : handlers)
+        for (auto &route : routes)
         {
-            // 获取正则表达式
-            const std::regex &re = handler.first;
-            // 获取处理函数
-            const Handler &functor = handler.second;
             // 使用正则表达式匹配请求路径
-            bool ret = std::regex_match(req._path, req._matches, re);
+            bool ret = std::regex_match(req._path, req._matches, route._re);
             if (ret == false)
             {
                 continue;
             }
+            // 耗时的处理函数交给计算线程池
+            if (route._offload)
+            {
+                OffloadHandler(conn, req, route);
+                return true;
+            }
             // 匹配成功则调用处理函数
-            return functor(req, rsp); 
+            route._handler(req, rsp);
+            return false;
         }
         // 没有匹配到处理函数，设置响应状态码为404
         rsp->_statu = 404;
+        return false;
     }
-    // 请求路由函数，根据请求类型和资源路径分发请求
-    void Route(HttpRequest &req, HttpResponse *rsp)
+    // 请求路由函数，根据请求类型和资源路径分发请求，请求交给了计算线程池异步处理时返回true
+    bool Route(const PtrConnection &conn, HttpRequest &req, HttpResponse *rsp)
     {
         // 1. 对请求进行分辨，是一个静态资源请求，还是一个功能性请求
         //    静态资源请求，则进行静态资源的处理
         //    功能性请求，则需要通过几个请求路由表来确定是否有处理函数
         //    既不是静态资源请求，也没有设置对应的功能性请求处理函数，就返回405
         // 判断是否为静态资源请求
-        if (IsFileHandler(req) == true)
+        PtrFileEntry entry;
+        if (IsFileHandler(req, &entry) == true)
         {
             // 是一个静态资源请求, 则进行静态资源请求的处理
-            return FileHandler(req, rsp);
+            FileHandler(rsp, entry);
+            return false;
         }
         // 如果是GET或HEAD请求
         if (req._method == "GET" || req._method == "HEAD")
         {
             // 调用GET请求的分发器
-            return Dispatcher(req, rsp, _get_route);
+            return Dispatcher(conn, req, rsp, _get_route);
         }
         // 如果是POST请求
         else if (req._method == "POST")
         {
             // 调用POST请求的分发器
-            return Dispatcher(req, rsp, _post_route);
+            return Dispatcher(conn, req, rsp, _post_route);
         }
         // 如果是PUT请求
         else if (req._method == "PUT")
         {
             // 调用PUT请求的分发器
-            return Dispatcher(req, rsp, _put_route);
+            return Dispatcher(conn, req, rsp, _put_route);
         }
         // 如果是DELETE请求
         else if (req._method == "DELETE")
         {
             // 调用DELETE请求的分发器
-            return Dispatcher(req, rsp, _delete_route);
+            return Dispatcher(conn, req, rsp, _delete_route);
         }
         // 不支持的请求方法，设置响应状态码为405
         rsp->_statu = 405; 
-        return;
+        return false;
     }
     // 当有新的连接建立时调用，设置连接的上下文
     void OnConnected(const PtrConnection &conn)
@@ -241,9 +285,19 @@ private:
         // 当缓冲区有可读数据时循环处理
         while (buffer->ReadAbleSize() > 0)
         {
+            // 待发送的响应已经超过高水位线，暂停处理后续请求，等响应发送到低水位线以下时连接会再次调用本函数
+            if (conn->OverHighWaterMark())
+            {
+                return;
+            }
             // 1. 获取上下文
             // 获取连接的上下文并转换为HttpContext指针
             HttpContext *context = conn->GetContext()->get<HttpContext>();
+            // 上一个请求还在计算线程池中处理，响应必须按请求的顺序发送，后续的请求留在缓冲区中，处理完之后再继续
+            if (context->Busy())
+            {
+                return;
+            }
             // 2. 通过上下文对缓冲区数据进行解析，得到HttpRequest对象
             //   1. 如果缓冲区的数据解析出错，就直接回复出错响应
             //   2. 如果解析正常，且请求已经获取完毕，才开始去进行处理
@@ -276,8 +330,13 @@ private:
                 return;
             }
             // 3. 请求路由 + 业务处理
-            // 调用路由函数处理请求
-            Route(req, &rsp);
+            // 调用路由函数处理请求，请求交给了计算线程池时，响应由计算完成后发送
+            if (Route(conn, req, &rsp) == true)
+            {
+                context->ReSet();
+                context->SetBusy(true);
+                return;
+            }
             // 4. 对HttpResponse进行组织发送
             // 组织并发送响应
             WriteReponse(conn, req, rsp);
@@ -312,30 +371,36 @@ public:
         // 设置静态资源根目录
         _basedir = path;
     }
+    // 设置静态资源文件缓存的容量（最多缓存的文件数量）和有效期（毫秒），容量为 0 表示关闭缓存
+    void SetFileCache(size_t capacity, uint64_t ttl)
+    {
+        _file_cache.SetLimit(capacity, ttl);
+    }
     /*设置/添加，请求（请求的正则表达）与处理函数的映射关系*/
+    /*offload为true表示处理函数比较耗时，交给计算线程池执行，不阻塞处理连接的线程（需要设置计算线程数量）*/
     // 添加GET请求的路由规则
-    void Get(const std::string &pattern, const Handler &handler)
+    void Get(const std::string &pattern, const Handler &handler, bool offload = false)
     {
         // 将正则表达式和处理函数添加到GET请求的路由表中
-        _get_route.push_back(std::make_pair(std::regex(pattern), handler));
+        _get_route.push_back(RouteRule(pattern, handler, offload));
     }
     // 添加POST请求的路由规则
-    void Post(const std::string &pattern, const Handler &handler)
+    void Post(const std::string &pattern, const Handler &handler, bool offload = false)
     {
         // 将正则表达式和处理函数添加到POST请求的路由表中
-        _post_route.push_back(std::make_pair(std::regex(pattern), handler));
+        _post_route.push_back(RouteRule(pattern, handler, offload));
     }
     // 添加PUT请求的路由规则
-    void Put(const std::string &pattern, const Handler &handler)
+    void Put(const std::string &pattern, const Handler &handler, bool offload = false)
     {
         // 将正则表达式和处理函数添加到PUT请求的路由表中
-        _put_route.push_back(std::make_pair(std::regex(pattern), handler));
+        _put_route.push_back(RouteRule(pattern, handler, offload));
     }
     // 添加DELETE请求的路由规则
-    void Delete(const std::string &pattern, const Handler &handler)
+    void Delete(const std::string &pattern, const Handler &handler, bool offload = false)
     {
         // 将正则表达式和处理函数添加到DELETE请求的路由表中
-        _delete_route.push_back(std::make_pair(std::regex(pattern), handler));
+        _delete_route.push_back(RouteRule(pattern, handler, offload));
     }
     // 设置服务器的线程数量
     void SetThreadCount(int count)
@@ -343,7 +408,72 @@ public:
         // 设置底层TCP服务器的线程数量
         _server.SetThreadCount(count);
     }
-    // 启动服务器监听
+    // 设置计算线程池的线程数量，耗时的路由处理函数在计算线程池中执行
+    void SetComputeThreads(int count)
+    {
+        _server.SetComputeThreads(count);
+    }
+    // 设置服务器线程绑定的 CPU，cpus 为空表示使用所有允许的 CPU，reserved 中的 CPU 不绑定
+    void SetCpuAffinity(const std::vector<int> &cpus, const std::vector<int> &reserved = std::vector<int>())
+    {
+        _server.SetCpuAffinity(cpus, reserved);
+    }
+    // 开启忙轮询模式，处理连接的线程阻塞等待事件之前先忙轮询usec微秒，降低请求到达时的唤醒延迟
+    void SetBusyPoll(int usec)
+    {
+        _server.SetBusyPoll(usec);
+    }
+    // 设置定时器合并时间（毫秒），超时检测最多推迟这么久，换取更少的唤醒次数
+    void SetTimerSlack(uint64_t ms)
+    {
+        _server.SetTimerSlack(ms);
+    }
+    // 设置新连接分配到从属线程的策略
+    void SetLoadBalance(LoadBalance balance)
+    {
+        _server.SetLoadBalance(balance);
+    }
+    // 设置从属线程事件监控使用的后端，POLLER_URING 使用 io_uring 批量提交
+    void SetPollerBackend(PollerBackend backend)
+    {
+        _server.SetPollerBackend(backend);
+    }
+    // 设置每个连接的输出高低水位线，待发送的响应超过high时暂停接收新的请求，回落到low以下时恢复
+    void SetWaterMarks(uint64_t high, uint64_t low)
+    {
+        _server.SetWaterMarks(high, low);
+    }
+    // 设置写停滞超时时间（秒），客户端长时间不接收响应时释放连接
+    void SetWriteStallTimeout(int sec)
+    {
+        _server.SetWriteStallTimeout(sec);
+    }
+    // 开启SO_REUSEPORT监听模式，每个从属线程各自接受连接，主线程不再参与建连
+    void EnableReusePort()
+    {
+        _server.EnableReusePort();
+    }
+    // 开启边缘触发模式，减少部分读取后的重复唤醒以及发送响应前后的epoll_ctl调用
+    void EnableEdgeTriggered()
+    {
+        _server.EnableEdgeTriggered();
+    }
+    // 开启零拷贝发送，不小于threshold字节的响应正文使用MSG_ZEROCOPY发送
+    void EnableZeroCopy(uint64_t threshold = DEFAULT_ZEROCOPY_THRESHOLD)
+    {
+        _server.EnableZeroCopy(threshold);
+    }
+    // 开启监听套接字交接：新版本进程启动时接管旧进程的监听套接字，旧进程排空连接后退出，发布时服务不中断
+    void EnableHandoff(const std::string &path, int drain_sec = DEFAULT_DRAIN_TIMEOUT)
+    {
+        _server.EnableHandoff(path, drain_sec);
+    }
+    // 停止服务器，可以在任意线程中调用，已有连接最多等待drain_sec秒处理完毕，之后Listen返回
+    void Stop(int drain_sec = DEFAULT_DRAIN_TIMEOUT)
+    {
+        _server.Stop(drain_sec);
+    }
+    // 启动服务器监听，服务器停止后返回
     void Listen()
     {
         // 启动底层TCP服务器
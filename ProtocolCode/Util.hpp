@@ -1,6 +1,7 @@
 #pragma once
 #include"statuANDmime.hpp"
 #include<sys/stat.h>
+#include<fcntl.h>
 
 // 定义一个工具类 Util，其中的方法都是静态的，提供一些常用的工具函数
 class Util
@@ -32,15 +32,23 @@ void DelFile(const HttpRequest &req, HttpResponse *rsp)
 {
     rsp->SetContent(RequestStr(req), "text/plain");
 }
+void Slow(const HttpRequest &req, HttpResponse *rsp) 
+{
+    // 模拟耗时的业务处理，注册时指定了offload，在计算线程池中执行
+    usleep(200 * 1000);
+    rsp->SetContent(RequestStr(req), "text/plain");
+}
 int main()
 {
     HttpServer server(8888);
     server.SetThreadCount(3);
+    server.SetComputeThreads(2);
     server.SetBaseDir(WWWROOT);//设置静态资源根目录，告诉服务器有静态资源请求到来，需要到哪里去找资源文件
     server.Get("/hello", Hello);
     server.Post("/login", Login);
     server.Put("/1234.txt", PutFile);
     server.Delete("/1234.txt", DelFile);
+    server.Get("/slow", Slow, true);
     server.Listen();
     return 0;
 }
\ No newline at end of file
@@ -1,6 +1,12 @@
+#pragma once
 #include"Socket.hpp"
 #include "EventLoop.hpp"
 
+// 一次可读事件中最多接受的新连接数量，剩余的连接留给下一轮事件循环，避免建连风暴时长时间占用事件循环
+#define MAX_ACCEPT_PER_ROUND 128
+// 描述符耗尽并且没有预留描述符可用时，暂停监听的时间，单位为毫秒
+#define ACCEPT_RETRY_MS 100
+
 // Acceptor 类负责创建监听套接字，并处理新的连接请求
 class Acceptor
 {
@@ -12,32 +18,102 @@ private:
     // 用于对监听套接字进行事件管理，将事件和回调函数关联起来
     Channel _channel; 
 
-    // 定义一个回调函数类型，用于处理新连接。参数为新连接的文件描述符
-    using AcceptCallback = std::function<void(int)>;
+    // 预留的空闲描述符，进程描述符耗尽时临时释放它，用来接受并立即关闭连接，避免监听套接字一直可读导致空转
+    int _idle_fd;
+    // 暂停监听后恢复监听的定时器
+    TimerNode _retry_timer;
+
+    // 定义一个回调函数类型，用于处理新连接。参数为本轮接受到的所有新连接的文件描述符
+    using AcceptCallback = std::function<void(const std::vector<int> &)>;
     // 存储处理新连接的回调函数
     AcceptCallback _accept_callback;
 
 private:
-    /*监听套接字的读事件回调处理函数---获取新连接，调用_accept_callback函数进行新连接处理*/
+    // 描述符耗尽：连接一直留在监听队列中，监听套接字会一直可读
+    // 释放预留的描述符，接受这个连接并立即关闭，然后重新预留，让客户端尽快得到结果；没有预留的描述符时返回 false
+    bool DropConnection()
+    {
+        if (_idle_fd < 0)
+            return false;
+        close(_idle_fd);
+        int fd = _socket.Accept();
+        if (fd >= 0)
+        {
+            LOG(WARNING, "TOO MANY OPEN FILES, DROP NEW CONNECTION\n");
+            close(fd);
+        }
+        _idle_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        return true;
+    }
+
+    // 描述符耗尽并且没有预留的描述符（重新预留失败）：监听套接字是水平触发的，会一直可读，继续监控只会空转
+    // 暂时停止读事件监控，等一段时间再尝试重新预留描述符并恢复监控
+    void PauseListen()
+    {
+        LOG(WARNING, "TOO MANY OPEN FILES AND NO IDLE FD, PAUSE ACCEPT FOR %d MS\n", ACCEPT_RETRY_MS);
+        _channel.DisableRead();
+        _loop->TimerStart(&_retry_timer, ACCEPT_RETRY_MS);
+    }
+
+    // 暂停到期，重新预留描述符并恢复读事件监控；仍然没有空闲描述符时，恢复后再次遇到描述符耗尽会继续暂停
+    void ResumeListen()
+    {
+        if (_idle_fd < 0)
+            _idle_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        _channel.EnableRead();
+    }
+
+    /*监听套接字的读事件回调处理函数---循环获取新连接，直到没有新连接或者达到本轮上限，再一次性交给_accept_callback处理*/
     void HandleRead()
     {
-        // 调用 _socket 的 Accept 方法获取新连接的文件描述符
-        int newfd = _socket.Accept();
-        // 如果获取新连接失败，直接返回
-        if (newfd < 0)
+        std::vector<int> fds;
+        if (_channel.Multishot() == MULTISHOT_ACCEPT)
         {
+            // io_uring 多次触发 accept 已经接受好了新连接，直接取走；描述符耗尽时请求被内核结束，下一轮重新提交
+            int err = _loop->TakeAccepted(&_channel, &fds);
+            if ((err == EMFILE || err == ENFILE) && DropConnection() == false)
+                PauseListen();
+            else if (err != 0 && err != ECONNABORTED && err != EINTR)
+                LOG(ERROR, "SOCKET ACCEPT FAILED:%s\n", strerror(err));
+            if (fds.empty() == false && _accept_callback)
+                _accept_callback(fds);
             return;
         }
+        for (int i = 0; i < MAX_ACCEPT_PER_ROUND; i++)
+        {
+            // 调用 _socket 的 Accept 方法获取新连接的文件描述符
+            int newfd = _socket.Accept();
+            if (newfd >= 0)
+            {
+                fds.push_back(newfd);
+                continue;
+            }
+            // 被信号打断，或者连接在接受之前已经被对端重置，继续获取下一个
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            // 描述符耗尽，丢弃一个连接后继续；没有预留的描述符可用时暂停监听
+            if (errno == EMFILE || errno == ENFILE)
+            {
+                if (DropConnection())
+                    continue;
+                PauseListen();
+                break;
+            }
+            // 没有新连接了（EAGAIN），或者其他错误
+            break;
+        }
         // 如果设置了处理新连接的回调函数，则调用该回调函数处理新连接
-        if (_accept_callback)
-            _accept_callback(newfd);
+        if (fds.empty() == false && _accept_callback)
+            _accept_callback(fds);
     }
 
     // 创建服务器监听套接字的函数，接受端口号作为参数
-    int CreateServer(int port)
+    int CreateServer(int port, bool reuse_port)
     {
-        // 调用 _socket 的 CreateServer 方法创建服务器监听套接字
-        bool ret = _socket.CreateServer(port);
+        // 调用 _socket 的 CreateServer 方法创建服务器监听套接字，监听套接字设置为非阻塞，以便循环接受到没有新连接为止
+        bool ret = _socket.CreateServer(port, "0.0.0.0", true, reuse_port);
         // 断言创建服务器套接字成功，如果失败则程序终止
         assert(ret == true);
         // 返回监听套接字的文件描述符
@@ -47,17 +123,31 @@ private:
 public:
     /*不能将启动读事件监控，放到构造函数中，必须在设置回调函数后，再去启动*/
     /*否则有可能造成启动监控后，立即有事件，处理的时候，回调函数还没设置：新连接得不到处理，且资源泄漏*/
-    // 构造函数，接受 EventLoop 指针和端口号作为参数
-    Acceptor(EventLoop *loop, int port) : 
+    // 构造函数，接受 EventLoop 指针和端口号作为参数，fd 不小于 0 时直接使用这个已经在监听的套接字（从旧进程交接过来的）
+    // reuse_port 为 true 时监听套接字开启 SO_REUSEPORT，多个 Acceptor 绑定同一个端口
+    Acceptor(EventLoop *loop, int port, int fd = -1, bool reuse_port = false) : 
         // 调用 CreateServer 方法创建监听套接字
-        _socket(CreateServer(port)), 
+        _socket(fd >= 0 ? fd : CreateServer(port, reuse_port)), 
         // 保存传入的 EventLoop 指针
         _loop(loop), 
         // 创建一个 Channel 对象，用于管理监听套接字的事件
-        _channel(loop, _socket.Fd())
+        _channel(loop, _socket.Fd()),
+        // 打开预留的空闲描述符
+        _idle_fd(open("/dev/null", O_RDONLY | O_CLOEXEC))
     {
         // 为 Channel 对象设置读事件的回调函数，当监听套接字有读事件发生时，调用 HandleRead 方法
         _channel.SetReadCallback(std::bind(&Acceptor::HandleRead, this));
+        _retry_timer.SetCallback(std::bind(&Acceptor::ResumeListen, this));
+        // io_uring 后端下由内核持续接受新连接，省去每个连接一次 accept4 系统调用
+        if (loop->SupportsMultishot())
+            _channel.SetMultishot(MULTISHOT_ACCEPT);
+    }
+
+    // 析构函数，关闭预留的空闲描述符
+    ~Acceptor()
+    {
+        if (_idle_fd >= 0)
+            close(_idle_fd);
     }
 
     // 设置处理新连接的回调函数
@@ -65,4 +155,17 @@ public:
 
     // 启动监听套接字的读事件监控
     void Listen() { _channel.EnableRead(); }
+
+    // 停止接受新连接，移除监听套接字的事件监控，需要在所属的 EventLoop 线程中调用；监听套接字在析构时关闭
+    void Stop()
+    {
+        _loop->TimerStop(&_retry_timer);
+        _channel.Remove();
+    }
+
+    // 获取监听套接字的文件描述符
+    int Fd() { return _socket.Fd(); }
+
+    // 获取监听套接字所属的 EventLoop
+    EventLoop *GetLoop() { return _loop; }
 };
\ No newline at end of file
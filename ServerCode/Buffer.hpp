@@ -1,4 +1,6 @@
+#pragma once
 #include"../Log.hpp"
+#include"BufferPool.hpp"
 #include<vector>
 #include<cassert>
 #include <stdint.h>
@@ -12,8 +14,10 @@ using namespace log_ns;
 class Buffer
 {
 private:
-    // 使用 vector 进行内存空间管理，存储实际的数据
-    std::vector<char> _buffer; 
+    // 存储实际数据的内存空间，从当前线程所属 EventLoop 的内存池中申请
+    char *_buffer;
+    // 内存空间的总大小
+    uint64_t _capacity;
     // 读偏移量，指示当前可读数据的起始位置
     uint64_t _reader_idx;      
     // 写偏移量，指示当前可写数据的起始位置
@@ -21,10 +25,45 @@ private:
 
 public:
     // 构造函数，初始化读偏移和写偏移为 0，并分配默认大小的缓冲区
-    Buffer() : _reader_idx(0), _writer_idx(0), _buffer(BUFFER_DEFAULT_SIZE) {}
+    Buffer() : _reader_idx(0), _writer_idx(0)
+    {
+        _buffer = BufferPool::Allocate(BUFFER_DEFAULT_SIZE, &_capacity);
+    }
+
+    // 拷贝构造函数，只拷贝可读数据
+    Buffer(const Buffer &other) : _reader_idx(0), _writer_idx(0)
+    {
+        uint64_t rsz = other._writer_idx - other._reader_idx;
+        _buffer = BufferPool::Allocate(rsz > BUFFER_DEFAULT_SIZE ? rsz : BUFFER_DEFAULT_SIZE, &_capacity);
+        std::copy(other._buffer + other._reader_idx, other._buffer + other._writer_idx, _buffer);
+        _writer_idx = rsz;
+    }
+
+    // 移动构造函数，直接接管对方的内存空间，对方变为空缓冲区
+    Buffer(Buffer &&other) : _buffer(other._buffer), _capacity(other._capacity),
+                             _reader_idx(other._reader_idx), _writer_idx(other._writer_idx)
+    {
+        other._buffer = NULL;
+        other._capacity = 0;
+        other._reader_idx = 0;
+        other._writer_idx = 0;
+    }
+
+    // 赋值运算符的重载函数，拷贝和移动都通过交换实现
+    Buffer &operator=(Buffer other)
+    {
+        std::swap(_buffer, other._buffer);
+        std::swap(_capacity, other._capacity);
+        std::swap(_reader_idx, other._reader_idx);
+        std::swap(_writer_idx, other._writer_idx);
+        return *this;
+    }
+
+    // 析构函数，把内存空间归还给内存池
+    ~Buffer() { BufferPool::Deallocate(_buffer, _capacity); }
 
     // 返回缓冲区的起始地址
-    char *Begin() { return &*_buffer.begin(); }
+    char *Begin() { return _buffer; }
 
     // 获取当前写入起始地址，即 _buffer 的空间起始地址加上写偏移量
     char *WritePosition() { return Begin() + _writer_idx; }
@@ -33,7 +72,7 @@ public:
     char *ReadPosition() { return Begin() + _reader_idx; }
 
     // 获取缓冲区末尾空闲空间大小，即总体空间大小减去写偏移量
-    uint64_t TailIdleSize() { return _buffer.size() - _writer_idx; }
+    uint64_t TailIdleSize() { return _capacity - _writer_idx; }
 
     // 获取缓冲区起始空闲空间大小，即读偏移量
     uint64_t HeadIdleSize() { return _reader_idx; }
@@ -84,9 +123,21 @@ public:
         }
         else
         {
-            // 总体空间不够，则需要扩容，不移动数据，直接给写偏移之后扩容足够空间
-            LOG(DEBUG, "RESIZE %ld\n", _writer_idx + len);
-            _buffer.resize(_writer_idx + len);
+            // 总体空间不够，则需要扩容：申请一块新空间，只把可读数据拷贝到新空间的起始位置
+            uint64_t rsz = ReadAbleSize();
+            // 至少按两倍增长，避免连续小块追加时反复扩容拷贝
+            uint64_t need = rsz + len;
+            if (need < _capacity * 2)
+                need = _capacity * 2;
+            LOG(DEBUG, "RESIZE %ld\n", need);
+            uint64_t cap = 0;
+            char *buf = BufferPool::Allocate(need, &cap);
+            std::copy(ReadPosition(), ReadPosition() + rsz, buf);
+            BufferPool::Deallocate(_buffer, _capacity);
+            _buffer = buf;
+            _capacity = cap;
+            _reader_idx = 0;
+            _writer_idx = rsz;
         }
     }
 
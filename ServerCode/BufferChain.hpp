@@ -0,0 +1,163 @@
+#pragma once
+#include "Buffer.hpp"
+#include <deque>
+#include <memory>
+#include <string>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+// 一次 sendmsg 最多能携带的数据块数量
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+// 引用计数管理的只读数据，同一份数据（例如缓存的响应、广播帧）可以同时挂到任意多个连接的发送队列上而不需要拷贝
+using SharedPayload = std::shared_ptr<const std::string>;
+
+// 文件描述符的持有者，最后一个引用释放时关闭文件，用于文件数据块直接通过 sendfile 发送
+class FileHandle
+{
+private:
+    int _fd; // 打开的文件描述符
+
+public:
+    // 构造函数，接管传入的文件描述符
+    explicit FileHandle(int fd) : _fd(fd) {}
+    // 析构函数，关闭文件描述符
+    ~FileHandle()
+    {
+        if (_fd >= 0)
+            close(_fd);
+    }
+    // 获取文件描述符
+    int Fd() { return _fd; }
+};
+
+// 定义一个智能指针类型，用于共享管理打开的文件
+using PtrFile = std::shared_ptr<FileHandle>;
+
+// 缓冲区链类，用于管理输出数据：每次发送的数据作为一个独立的数据块挂在链上，
+// 不再拷贝合并到一块连续空间中，发送时通过 sendmsg 一次系统调用把多个数据块一起发送出去
+class BufferChain
+{
+public:
+    // 数据块，指向一段待发送的数据，并通过引用计数持有数据的所有者，保证数据在发送完毕之前一直有效
+    // 数据块有两种：内存数据块（_file_fd 为 -1），以及文件数据块（数据在文件 _file_fd 的 _offset 处，发送时使用 sendfile）
+    struct Segment
+    {
+        std::shared_ptr<void> _owner; // 数据的所有者，可能是 Buffer、std::string、FileHandle 等
+        const char *_data;            // 内存数据块：待发送数据的起始地址
+        int _file_fd;                 // 文件数据块：文件描述符，内存数据块为 -1
+        off_t _offset;                // 文件数据块：待发送数据在文件中的偏移
+        uint64_t _len;                // 待发送数据的长度
+
+        // 判断是否是文件数据块
+        bool IsFile() const { return _file_fd >= 0; }
+    };
+
+private:
+    // 数据块队列，队首是最先要发送的数据
+    std::deque<Segment> _segments;
+    // 链上所有数据块的可读数据总量
+    uint64_t _size;
+
+public:
+    // 构造函数，初始化数据总量为 0
+    BufferChain() : _size(0) {}
+
+    // 获取链上所有数据块的可读数据总量
+    uint64_t ReadAbleSize() { return _size; }
+
+    // 获取链上数据块的数量
+    size_t SegmentCount() { return _segments.size(); }
+
+    // 挂一个数据块到链尾，数据本身不会被拷贝，只增加所有者的引用计数
+    void Append(const std::shared_ptr<void> &owner, const char *data, uint64_t len)
+    {
+        // 空的数据块没有必要挂到链上
+        if (len == 0)
+            return;
+        Segment seg;
+        seg._owner = owner;
+        seg._data = data;
+        seg._file_fd = -1;
+        seg._offset = 0;
+        seg._len = len;
+        _size += len;
+        _segments.push_back(std::move(seg));
+    }
+
+    // 挂一个文件数据块到链尾，发送时由内核直接从文件拷贝到套接字，数据不经过用户空间
+    void AppendFile(const PtrFile &file, off_t offset, uint64_t len)
+    {
+        if (len == 0)
+            return;
+        Segment seg;
+        seg._owner = file;
+        seg._data = NULL;
+        seg._file_fd = file->Fd();
+        seg._offset = offset;
+        seg._len = len;
+        _size += len;
+        _segments.push_back(std::move(seg));
+    }
+
+    // 获取队首的数据块，调用前需确保链不为空
+    Segment &Front()
+    {
+        assert(_segments.empty() == false);
+        return _segments.front();
+    }
+
+    // 从队首开始填充 iovec 数组，最多填充 max 个，遇到文件数据块就停止，返回实际填充的数量
+    // stop_len 不为 0 时，遇到长度不小于 stop_len 的内存数据块也停止，这样的大数据块留给调用者单独以零拷贝方式发送
+    // *more 用于告知调用者在填充的数据之后链上是否还有数据，可以据此设置 MSG_MORE
+    int GetIovec(struct iovec *iov, int max, bool *more = NULL, uint64_t stop_len = 0)
+    {
+        int cnt = 0;
+        for (auto &seg : _segments)
+        {
+            if (cnt >= max || seg.IsFile() || (stop_len > 0 && seg._len >= stop_len))
+                break;
+            iov[cnt].iov_base = (void *)seg._data;
+            iov[cnt].iov_len = seg._len;
+            cnt++;
+        }
+        if (more)
+            *more = (cnt < (int)_segments.size());
+        return cnt;
+    }
+
+    // 将读偏移向后移动指定长度，已经全部发送完毕的数据块从链上摘除
+    void MoveReadOffset(uint64_t len)
+    {
+        // 确保向后移动的大小小于等于可读数据大小
+        assert(len <= _size);
+        _size -= len;
+        while (len > 0)
+        {
+            Segment &front = _segments.front();
+            if (len < front._len)
+            {
+                // 队首数据块只发送了一部分，移动其起始位置即可
+                if (front.IsFile())
+                    front._offset += len;
+                else
+                    front._data += len;
+                front._len -= len;
+                return;
+            }
+            // 队首数据块已经发送完毕，从链上移除，同时释放对数据所有者的引用
+            len -= front._len;
+            _segments.pop_front();
+        }
+    }
+
+    // 清空缓冲区链
+    void Clear()
+    {
+        _segments.clear();
+        _size = 0;
+    }
+};
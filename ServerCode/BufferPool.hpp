@@ -0,0 +1,138 @@
+#pragma once
+#include <new>
+#include <stdint.h>
+#include <stddef.h>
+
+// 最小的内存块大小为 2^10 = 1KB，与缓冲区的默认大小一致
+#define BUFFER_POOL_MIN_SHIFT 10
+// 内存块大小分级的数量：1KB、2KB、4KB ... 64KB，超过最大级别的内存直接向系统申请
+#define BUFFER_POOL_CLASSES 7
+// 每个大小级别最多缓存的空闲内存总量，超出部分直接归还给系统
+#define BUFFER_POOL_CLASS_LIMIT (4 * 1024 * 1024)
+
+// 缓冲区内存池类，按大小分级缓存空闲的内存块，由每个 EventLoop 持有一个
+// 缓冲区从当前线程所属 EventLoop 的内存池中申请内存，释放时归还到释放线程的内存池中，
+// 连接的建立和销毁不再反复调用全局的内存分配器；内存池只被所属线程访问，因此不需要加锁
+class BufferPool
+{
+private:
+    // 空闲内存块链表节点，直接复用空闲内存块的起始空间
+    struct FreeNode
+    {
+        FreeNode *_next;
+    };
+    // 每个大小级别的空闲链表
+    FreeNode *_free[BUFFER_POOL_CLASSES];
+    // 每个大小级别当前缓存的空闲块数量
+    size_t _count[BUFFER_POOL_CLASSES];
+
+private:
+    // 获取指定级别的内存块大小
+    static uint64_t ClassSize(int cls) { return (uint64_t)1 << (cls + BUFFER_POOL_MIN_SHIFT); }
+
+    // 根据申请的大小计算所属的级别，超过最大级别返回 -1
+    static int SizeClass(uint64_t size)
+    {
+        for (int cls = 0; cls < BUFFER_POOL_CLASSES; cls++)
+        {
+            if (size <= ClassSize(cls))
+                return cls;
+        }
+        return -1;
+    }
+
+    // 从空闲链表中取出一块内存，链表为空则向系统申请
+    char *Get(int cls)
+    {
+        FreeNode *node = _free[cls];
+        if (node == NULL)
+        {
+            return (char *)::operator new(ClassSize(cls));
+        }
+        _free[cls] = node->_next;
+        _count[cls]--;
+        return (char *)node;
+    }
+
+    // 把一块内存放回空闲链表，该级别缓存已满则归还给系统
+    void Put(int cls, char *ptr)
+    {
+        if (_count[cls] * ClassSize(cls) >= BUFFER_POOL_CLASS_LIMIT)
+        {
+            ::operator delete(ptr);
+            return;
+        }
+        FreeNode *node = (FreeNode *)ptr;
+        node->_next = _free[cls];
+        _free[cls] = node;
+        _count[cls]++;
+    }
+
+public:
+    // 构造函数，初始化所有空闲链表为空
+    BufferPool()
+    {
+        for (int cls = 0; cls < BUFFER_POOL_CLASSES; cls++)
+        {
+            _free[cls] = NULL;
+            _count[cls] = 0;
+        }
+    }
+
+    // 析构函数，把缓存的空闲内存块全部归还给系统
+    ~BufferPool()
+    {
+        for (int cls = 0; cls < BUFFER_POOL_CLASSES; cls++)
+        {
+            while (_free[cls])
+            {
+                FreeNode *node = _free[cls];
+                _free[cls] = node->_next;
+                ::operator delete(node);
+            }
+        }
+    }
+
+    // 当前线程所属的内存池，由 EventLoop 在所属线程中设置，没有 EventLoop 的线程为 NULL
+    static BufferPool *&Current()
+    {
+        static thread_local BufferPool *pool = NULL;
+        return pool;
+    }
+
+    // 申请至少 size 字节的内存，通过 cap 返回实际可用的大小
+    static char *Allocate(uint64_t size, uint64_t *cap)
+    {
+        int cls = SizeClass(size);
+        if (cls < 0)
+        {
+            // 超过最大级别的内存不缓存，直接向系统申请
+            *cap = size;
+            return (char *)::operator new(size);
+        }
+        *cap = ClassSize(cls);
+        BufferPool *pool = Current();
+        if (pool == NULL)
+        {
+            return (char *)::operator new(*cap);
+        }
+        return pool->Get(cls);
+    }
+
+    // 释放 Allocate 申请的内存，cap 必须是申请时返回的大小
+    // 内存可以在任意线程释放，释放时归还到当前线程的内存池中
+    static void Deallocate(char *ptr, uint64_t cap)
+    {
+        if (ptr == NULL)
+            return;
+        int cls = SizeClass(cap);
+        BufferPool *pool = Current();
+        // 只有恰好是某个级别大小的内存块才能放回内存池
+        if (cls < 0 || ClassSize(cls) != cap || pool == NULL)
+        {
+            ::operator delete(ptr);
+            return;
+        }
+        pool->Put(cls, ptr);
+    }
+};
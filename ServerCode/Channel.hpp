@@ -7,6 +7,17 @@
 // 前向声明 EventLoop 类，避免头文件循环包含
 class EventLoop;
 
+// 读事件由 io_uring 的多次触发操作直接完成时的操作类型，只在 io_uring 后端下有效，epoll 后端忽略
+// MULTISHOT_NONE -- 普通的就绪通知，由读事件回调自己调用 accept/recv
+// MULTISHOT_ACCEPT -- 监听套接字，内核接受新连接，读事件回调通过 EventLoop::TakeAccepted 取走
+// MULTISHOT_RECV -- 连接套接字，内核把数据接收到提供缓冲区中，读事件回调通过 EventLoop::TakeReceived 取走
+typedef enum
+{
+    MULTISHOT_NONE,
+    MULTISHOT_ACCEPT,
+    MULTISHOT_RECV
+} MultishotOp;
+
 // Channel 类用于管理文件描述符的事件，与 EventLoop 配合使用
 class Channel
 {
@@ -15,6 +26,8 @@ private:
     EventLoop *_loop;  // 指向所属的 EventLoop 对象，用于事件循环和处理
     uint32_t _events;  // 当前需要监控的事件，使用 epoll 事件标志位表示
     uint32_t _revents; // 当前连接触发的事件，由 epoll 实际返回的事件
+    bool _registered;  // 是否已经添加到 epoll 中，由 Poller 维护，用于区分 EPOLL_CTL_ADD 和 EPOLL_CTL_MOD
+    MultishotOp _multishot; // 读事件使用的多次触发操作，需要在启动监控之前设置
     // 定义事件回调函数类型，使用 std::function 包装无参数无返回值的函数
     using EventCallback = std::function<void()>;
     EventCallback _read_callback;  // 可读事件被触发时调用的回调函数
@@ -27,7 +40,7 @@ public:
     // 构造函数，初始化 Channel 对象
     // loop: 所属的 EventLoop 对象
     // fd: 要监控的文件描述符
-    Channel(EventLoop *loop, int fd) : _fd(fd), _events(0), _revents(0), _loop(loop) {}
+    Channel(EventLoop *loop, int fd) : _fd(fd), _events(0), _revents(0), _registered(false), _multishot(MULTISHOT_NONE), _loop(loop) {}
 
     // 获取文件描述符
     int Fd() { return _fd; }
@@ -38,6 +51,18 @@ public:
     // 设置实际就绪的事件，由 epoll 返回的事件更新此值
     void SetREvents(uint32_t events) { _revents = events; }
 
+    // 判断是否已经添加到 epoll 中
+    bool Registered() { return _registered; }
+
+    // 设置是否已经添加到 epoll 中，只由 Poller 调用
+    void SetRegistered(bool registered) { _registered = registered; }
+
+    // 获取读事件使用的多次触发操作
+    MultishotOp Multishot() { return _multishot; }
+
+    // 设置读事件使用的多次触发操作，需要在启动读事件监控之前设置，之后不能再修改
+    void SetMultishot(MultishotOp op) { _multishot = op; }
+
     // 设置可读事件的回调函数
     void SetReadCallback(const EventCallback &cb) { _read_callback = cb; }
 
@@ -59,6 +84,13 @@ public:
     // 判断当前是否监控了可写事件
     bool WriteAble() { return (_events & EPOLLOUT); }
 
+    // 判断是否是边缘触发模式
+    bool EdgeTriggered() { return (_events & EPOLLET); }
+
+    // 设置为边缘触发模式，在下一次更新监控事件时生效；边缘触发模式下事件只在状态变化时报告一次，
+    // 使用者必须把数据读到 EAGAIN、写到 EAGAIN，否则剩余的数据不会再有事件通知
+    void EnableEdgeTriggered() { _events |= EPOLLET; }
+
     // 启动读事件监控
     void EnableRead()
     {
@@ -0,0 +1,182 @@
+#pragma once
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+// ComputePool 类是一个工作窃取的计算线程池，用于执行耗时的业务处理，避免阻塞 EventLoop 线程
+// 每个工作线程有自己的任务队列，外部提交的任务轮流放入各个队列，工作线程在执行任务时提交的任务放入自己的队列
+// 工作线程从自己队列的头部取任务，自己的队列空了就从其他线程队列的尾部窃取，耗时不均匀的任务也能分摊到所有线程上
+// 任务执行完之后，结果应当投递回连接所属的 EventLoop 中处理，计算线程不直接操作连接
+class ComputePool
+{
+public:
+    using Task = std::function<void()>;
+
+private:
+    // 工作线程及其任务队列
+    struct Worker
+    {
+        std::mutex _mutex;        // 保护任务队列，只在存取任务时短暂持有
+        std::deque<Task> _tasks;  // 任务队列
+        std::thread _thread;      // 工作线程
+    };
+
+    std::vector<std::unique_ptr<Worker>> _workers;
+    // 空闲的工作线程在这里等待新任务
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    // 所有队列中尚未取出的任务数量
+    std::atomic<int64_t> _pending;
+    // 正在等待新任务的工作线程数量，没有线程等待时提交任务不需要唤醒
+    std::atomic<int> _sleepers;
+    // 外部提交任务时轮流选择队列的索引
+    std::atomic<unsigned> _next;
+    // 是否要求工作线程退出
+    bool _quit;
+
+private:
+    // 当前线程所属的线程池以及它在线程池中的索引，不是工作线程时为 NULL
+    static ComputePool *&CurrentPool()
+    {
+        static thread_local ComputePool *pool = NULL;
+        return pool;
+    }
+    static int &CurrentIndex()
+    {
+        static thread_local int index = -1;
+        return index;
+    }
+
+    // 从自己的队列头部取一个任务
+    bool PopLocal(int idx, Task *task)
+    {
+        Worker &worker = *_workers[idx];
+        std::unique_lock<std::mutex> lock(worker._mutex);
+        if (worker._tasks.empty())
+            return false;
+        *task = std::move(worker._tasks.front());
+        worker._tasks.pop_front();
+        return true;
+    }
+
+    // 从其他线程的队列尾部窃取一个任务
+    bool Steal(int idx, Task *task)
+    {
+        int count = _workers.size();
+        for (int i = 1; i < count; i++)
+        {
+            Worker &victim = *_workers[(idx + i) % count];
+            std::unique_lock<std::mutex> lock(victim._mutex);
+            if (victim._tasks.empty())
+                continue;
+            *task = std::move(victim._tasks.back());
+            victim._tasks.pop_back();
+            return true;
+        }
+        return false;
+    }
+
+    // 工作线程入口函数
+    void ThreadEntry(int idx)
+    {
+        CurrentPool() = this;
+        CurrentIndex() = idx;
+        while (1)
+        {
+            Task task;
+            if (PopLocal(idx, &task) || Steal(idx, &task))
+            {
+                _pending.fetch_sub(1);
+                task();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(_mutex);
+            _sleepers.fetch_add(1);
+            _cond.wait(lock, [this]()
+                       { return _quit || _pending.load() > 0; });
+            _sleepers.fetch_sub(1);
+            // 退出前先执行完已经提交的任务
+            if (_quit && _pending.load() == 0)
+                return;
+        }
+    }
+
+    // 任务放入队列之后，唤醒一个等待中的工作线程
+    void Notify()
+    {
+        // 与等待线程的检查互相可见：要么提交者看到有线程在等待，要么等待者看到有未取出的任务
+        if (_sleepers.load() > 0)
+        {
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+            }
+            _cond.notify_one();
+        }
+    }
+
+public:
+    // 构造函数，创建 count 个工作线程
+    ComputePool(int count) : _pending(0), _sleepers(0), _next(0), _quit(false)
+    {
+        if (count < 1)
+            count = 1;
+        for (int i = 0; i < count; i++)
+        {
+            _workers.push_back(std::unique_ptr<Worker>(new Worker()));
+        }
+        // 队列全部创建之后再启动线程，工作线程窃取时会访问所有队列
+        for (int i = 0; i < count; i++)
+        {
+            _workers[i]->_thread = std::thread(&ComputePool::ThreadEntry, this, i);
+        }
+    }
+
+    ~ComputePool() { Stop(); }
+
+    ComputePool(const ComputePool &) = delete;
+    ComputePool &operator=(const ComputePool &) = delete;
+
+    // 提交一个任务，可以在任意线程中调用
+    void Submit(Task &&task)
+    {
+        int idx;
+        if (CurrentPool() == this)
+            idx = CurrentIndex();
+        else
+            idx = _next.fetch_add(1, std::memory_order_relaxed) % _workers.size();
+        {
+            Worker &worker = *_workers[idx];
+            std::unique_lock<std::mutex> lock(worker._mutex);
+            worker._tasks.push_back(std::move(task));
+        }
+        _pending.fetch_add(1);
+        Notify();
+    }
+    void Submit(const Task &task) { Submit(Task(task)); }
+
+    // 停止线程池：已经提交的任务执行完之后，所有工作线程退出
+    void Stop()
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _quit = true;
+        }
+        _cond.notify_all();
+        for (auto &worker : _workers)
+        {
+            if (worker->_thread.joinable())
+                worker->_thread.join();
+        }
+    }
+
+    // 获取工作线程数量
+    int Size() { return _workers.size(); }
+
+    // 获取尚未开始执行的任务数量
+    int64_t Pending() { return _pending.load(std::memory_order_relaxed); }
+};
@@ -1,8 +1,16 @@
 #include"Buffer.hpp"
+#include"BufferChain.hpp"
 #include "Socket.hpp"
 #include"EventLoop.hpp"
 #include"Any.hpp"
 
+// 接收数据时栈上扩展缓冲区的大小，接收缓冲区尾部空间不够时溢出到这里
+#define READ_EXTBUF_SIZE 65536
+// 一次可读事件中默认最多接收的数据量，超出的部分留给下一轮事件循环，避免单个连接饿死其他连接
+#define DEFAULT_READ_BUDGET (1024 * 1024)
+// 默认的零拷贝发送阈值，不小于它的数据块才使用 MSG_ZEROCOPY 发送；小数据块固定映射页面的开销比拷贝还大
+#define DEFAULT_ZEROCOPY_THRESHOLD (64 * 1024)
+
 // 前向声明Connection类
 class Connection;
 
@@ -28,12 +36,46 @@ class Connection : public std::enable_shared_from_this<Connection>
 private:
     // 连接的唯一ID，用于连接的管理和查找
     uint64_t _conn_id; 
-    // 注释掉的定时器ID，为简化操作，使用_conn_id作为定时器ID
-    // uint64_t _timer_id;   
     // 连接关联的文件描述符
     int _sockfd;                   
     // 连接是否启动非活跃销毁的判断标志，默认为false
     bool _enable_inactive_release; 
+    // 非活跃销毁定时器，每个事件只记录活跃时间，到期时再判断是否真的超时
+    TimerNode _inactive_timer;
+    // 一次可读事件中最多接收的数据量
+    uint64_t _read_budget;
+    // 输出高水位线，待发送数据超过它时暂停读事件监控，为 0 表示不限制
+    uint64_t _high_water_mark;
+    // 输出低水位线，暂停读之后待发送数据降到它以下时恢复读事件监控
+    uint64_t _low_water_mark;
+    // 是否因为待发送数据超过高水位线而暂停了读事件监控
+    bool _read_paused;
+    // 写停滞超时时间（秒），暂停读之后超过这个时间没有发出任何数据就释放连接，为 0 表示不检测
+    int _write_stall_timeout;
+    // 写停滞检测定时器
+    TimerNode _stall_timer;
+    // 最近一次成功发出数据的时间（毫秒），取自事件循环缓存的单调时钟，和定时器使用同一个时间源
+    uint64_t _last_send_time;
+    // 连接上还没有完成的异步处理（例如交给计算线程池的请求）的数量，大于 0 时对端关闭或者调用 Shutdown 都不会释放连接，
+    // 等处理完成、结果发送完之后再释放；出错、超时等强制释放不受影响
+    int _pending_works;
+    // 是否使用边缘触发模式：读写都进行到EAGAIN为止，写事件一直处于监控中
+    bool _edge_triggered;
+    // 边缘触发模式下，是否已经安排了本轮事件循环结束前的一次发送
+    bool _flush_queued;
+    // 零拷贝发送阈值，不小于它的内存数据块使用 MSG_ZEROCOPY 发送，为 0 表示不使用零拷贝发送
+    uint64_t _zerocopy_threshold;
+    // 下一次零拷贝发送的完成通知序号，内核从 0 开始为每次成功提交的零拷贝发送依次编号
+    uint32_t _zerocopy_seq;
+    // 已经提交给内核但还没有收到完成通知的零拷贝发送
+    struct ZeroCopyPending
+    {
+        uint32_t _seq;                // 完成通知序号
+        bool _done;                   // 是否已经收到完成通知
+        std::shared_ptr<void> _owner; // 数据的所有者，内核释放页面之前必须一直持有
+    };
+    // 按序号排列的零拷贝发送队列，队首收到完成通知之后才释放，通知乱序到达时先做标记
+    std::deque<ZeroCopyPending> _zerocopy_pending;
     // 连接所关联的一个EventLoop对象
     EventLoop *_loop;              
     // 连接的当前状态
@@ -44,8 +86,8 @@ private:
     Channel _channel;              
     // 输入缓冲区，用于存放从socket中读取到的数据
     Buffer _in_buffer;             
-    // 输出缓冲区，用于存放要发送给对端的数据
-    Buffer _out_buffer;            
+    // 输出缓冲区链，每次发送的数据作为独立的数据块排队，发送时一次sendmsg批量发出
+    BufferChain _out_buffer;       
     // 请求的接收处理上下文，可存储任意类型的数据
     Any _context;                  
 
@@ -58,6 +100,10 @@ private:
     using ClosedCallback = std::function<void(const PtrConnection &)>;
     // 发生任意事件时调用的回调函数
     using AnyEventCallback = std::function<void(const PtrConnection &)>;
+    // 待发送数据超过高水位线时调用的回调函数，参数为当前待发送数据量
+    using HighWaterMarkCallback = std::function<void(const PtrConnection &, uint64_t)>;
+    // 待发送数据回落到低水位线以下时调用的回调函数
+    using LowWaterMarkCallback = std::function<void(const PtrConnection &)>;
 
     // 连接建立成功时调用的回调函数对象
     ConnectedCallback _connected_callback;
@@ -67,6 +113,10 @@ private:
     ClosedCallback _closed_callback;
     // 发生任意事件时调用的回调函数对象
     AnyEventCallback _event_callback;
+    // 超过高水位线时调用的回调函数对象
+    HighWaterMarkCallback _high_water_callback;
+    // 回落到低水位线时调用的回调函数对象
+    LowWaterMarkCallback _low_water_callback;
 
     // 组件内的连接关闭回调，由组件内部设置，用于在连接关闭时从服务器管理中移除该连接信息
     ClosedCallback _server_closed_callback;
@@ -75,19 +125,57 @@ private:
     // 描述符可读事件触发后调用的函数，接收socket数据放到接收缓冲区中，然后调用_message_callback
     void HandleRead()
     {
+        if (_channel.Multishot() == MULTISHOT_RECV)
+        {
+            return HandleReceived();
+        }
         // 1. 接收socket的数据，放到缓冲区
-        // 定义一个缓冲区，用于临时存储从socket读取的数据
-        char buf[65536];
-        // 以非阻塞方式从socket读取数据
-        ssize_t ret = _socket.NonBlockRecv(buf, 65535);
-        if (ret < 0)
+        // 数据直接读入接收缓冲区尾部的空闲空间，只有尾部空间不够时才溢出到栈上的扩展缓冲区，避免每个字节都拷贝两次
+        char extbuf[READ_EXTBUF_SIZE];
+        // 本次可读事件中已经接收的数据总量，用于限制单个连接一次占用事件循环的时间
+        uint64_t total = 0;
+        while (total < _read_budget)
         {
-            // 出错了，不能直接关闭连接，调用ShutdownInLoop函数进行处理
-            return ShutdownInLoop();
+            uint64_t tail = _in_buffer.TailIdleSize();
+            struct iovec iov[2];
+            iov[0].iov_base = _in_buffer.WritePosition();
+            iov[0].iov_len = tail;
+            iov[1].iov_base = extbuf;
+            iov[1].iov_len = sizeof(extbuf);
+            ssize_t ret = _socket.RecvV(iov, 2);
+            if (ret < 0)
+            {
+                // 出错了或者对端关闭，不能直接关闭连接，调用ShutdownInLoop函数进行处理（已接收的数据会在其中处理）
+                return ShutdownInLoop();
+            }
+            // 等于0表示暂时没有数据可读了
+            if (ret == 0)
+            {
+                break;
+            }
+            if ((uint64_t)ret <= tail)
+            {
+                // 数据全部落在了接收缓冲区中，只需要移动写偏移
+                _in_buffer.MoveWriteOffset(ret);
+            }
+            else
+            {
+                // 尾部空间已写满，溢出的部分从扩展缓冲区追加进去
+                _in_buffer.MoveWriteOffset(tail);
+                _in_buffer.WriteAndPush(extbuf, ret - tail);
+            }
+            total += ret;
+            // 没有把两块缓冲区读满，说明内核接收缓冲区已经读空，省去一次必然返回EAGAIN的系统调用
+            if ((uint64_t)ret < tail + sizeof(extbuf))
+            {
+                break;
+            }
+        }
+        if (_edge_triggered && total >= _read_budget)
+        {
+            // 边缘触发模式下，因为达到接收上限而没有读空的数据不会再触发可读事件，推迟到下一轮事件监控之后继续读
+            _loop->QueueNextRound(std::bind(&Connection::ReadAgainInLoop, shared_from_this()));
         }
-        // 这里的等于0表示的是没有读取到数据，而并不是连接断开了，连接断开返回的是-1
-        // 将数据放入输入缓冲区，写入之后顺便将写偏移向后移动
-        _in_buffer.WriteAndPush(buf, ret);
         // 2. 调用message_callback进行业务处理
         if (_in_buffer.ReadAbleSize() > 0)
         {
@@ -97,31 +185,109 @@ private:
         }
     }
 
+    // io_uring 多次触发接收模式下的可读事件处理：内核已经把数据接收到了提供缓冲区中，不需要再调用recvmsg
+    // 把数据追加到接收缓冲区并立即归还提供缓冲区，然后调用_message_callback
+    void HandleReceived()
+    {
+        Buffer *in = &_in_buffer;
+        ssize_t ret = _loop->TakeReceived(&_channel, [in](const char *data, size_t len)
+                                          { in->WriteAndPush(data, len); });
+        if (ret < 0)
+        {
+            // 对端关闭或者出错，与recvmsg返回0的处理相同
+            return ShutdownInLoop();
+        }
+        if (_in_buffer.ReadAbleSize() > 0)
+        {
+            return _message_callback(shared_from_this(), &_in_buffer);
+        }
+    }
+
     // 描述符可写事件触发后调用的函数，将发送缓冲区中的数据进行发送
     void HandleWrite()
     {
-        // _out_buffer中保存的数据就是要发送的数据
-        // 以非阻塞方式将输出缓冲区的数据发送出去
-        ssize_t ret = _socket.NonBlockSend(_out_buffer.ReadPosition(), _out_buffer.ReadAbleSize());
-        if (ret < 0)
+        // 监控写事件时错误事件回调不会被调用，在这里顺便回收零拷贝完成通知
+        if (_zerocopy_pending.empty() == false)
+        {
+            ReapZeroCopy();
+        }
+        // _out_buffer中保存的数据就是要发送的数据，循环发送，直到发完或者套接字的发送缓冲区写满
+        while (_out_buffer.ReadAbleSize() > 0)
         {
-            // 发送错误就该关闭连接了
-            if (_in_buffer.ReadAbleSize() > 0)
+            ssize_t ret = 0;
+            // 本次期望发送的数据量，实际发送的少于它就说明发送缓冲区已经满了
+            uint64_t expect = 0;
+            if (_out_buffer.Front().IsFile())
             {
-                // 若输入缓冲区还有数据，调用_message_callback进行处理
-                _message_callback(shared_from_this(), &_in_buffer);
+                // 队首是文件数据块，使用sendfile由内核直接发送文件数据
+                BufferChain::Segment &seg = _out_buffer.Front();
+                off_t offset = seg._offset;
+                expect = seg._len;
+                ret = _socket.SendFile(seg._file_fd, &offset, seg._len);
+            }
+            else if (_zerocopy_threshold > 0 && _out_buffer.Front()._len >= _zerocopy_threshold)
+            {
+                // 队首是大的内存数据块，以零拷贝方式单独发送，数据的所有者要一直持有到内核发来完成通知
+                BufferChain::Segment &seg = _out_buffer.Front();
+                bool zerocopy = false;
+                expect = seg._len;
+                ret = _socket.SendZeroCopy(seg._data, seg._len, &zerocopy);
+                if (ret > 0 && zerocopy)
+                {
+                    ZeroCopyPending pending;
+                    pending._seq = _zerocopy_seq++;
+                    pending._done = false;
+                    pending._owner = seg._owner;
+                    _zerocopy_pending.push_back(std::move(pending));
+                }
+            }
+            else
+            {
+                // 把链上的内存数据块组织成iovec数组，以非阻塞方式一次性发送出去
+                struct iovec iov[IOV_MAX];
+                bool more = false;
+                int cnt = _out_buffer.GetIovec(iov, IOV_MAX, &more, _zerocopy_threshold);
+                for (int i = 0; i < cnt; i++)
+                {
+                    expect += iov[i].iov_len;
+                }
+                // 后边还有数据（例如紧跟着的文件数据块）时带上MSG_MORE，让响应头部和文件开头合并到同一批报文中
+                ret = _socket.SendV(iov, cnt, MSG_DONTWAIT | MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+            }
+            if (ret < 0)
+            {
+                // 发送错误就该关闭连接了
+                if (_in_buffer.ReadAbleSize() > 0)
+                {
+                    // 若输入缓冲区还有数据，调用_message_callback进行处理
+                    _message_callback(shared_from_this(), &_in_buffer);
+                }
+                // 调用Release函数进行实际的关闭释放操作
+                return Release(); 
+            }
+            // 千万不要忘了，将读偏移向后移动
+            _out_buffer.MoveReadOffset(ret); 
+            if (ret > 0)
+            {
+                // 记录发送进度，用于写停滞检测
+                _last_send_time = _loop->MonotonicMs();
+            }
+            if ((uint64_t)ret < expect)
+            {
+                // 发送缓冲区已满，等待下一次可写事件
+                break;
             }
-            // 调用Release函数进行实际的关闭释放操作
-            return Release(); 
         }
-        // 千万不要忘了，将读偏移向后移动
-        _out_buffer.MoveReadOffset(ret); 
+        // 待发送数据回落到低水位线以下，恢复读事件监控
+        CheckLowWaterMark();
         if (_out_buffer.ReadAbleSize() == 0)
         {
-            // 没有数据待发送了，关闭写事件监控
-            _channel.DisableWrite(); 
+            // 没有数据待发送了，关闭写事件监控；边缘触发模式下写事件一直保持监控，省去反复的epoll_ctl
+            if (_edge_triggered == false)
+                _channel.DisableWrite(); 
             // 如果当前是连接待关闭状态，则有数据，发送完数据释放连接，没有数据则直接释放
-            if (_statu == DISCONNECTING)
+            // 还有零拷贝发送没有完成时要等完成通知全部到达再释放，由HandleError处理；还有异步处理没有完成时等它完成
+            if (_statu == DISCONNECTING && _zerocopy_pending.empty() && _pending_works == 0)
             {
                 return Release();
             }
@@ -145,17 +311,48 @@ private:
     // 描述符触发出错事件
     void HandleError()
     {
+        // 开启零拷贝发送之后，完成通知也通过错误事件报告，取出通知之后如果套接字上没有真正的错误就继续正常工作
+        if (_zerocopy_threshold > 0 && ReapZeroCopy() && _socket.GetError() == 0)
+        {
+            // 待关闭的连接等最后一个完成通知到达之后再释放
+            if (_statu == DISCONNECTING && _out_buffer.ReadAbleSize() == 0 && _zerocopy_pending.empty() && _pending_works == 0)
+            {
+                Release();
+            }
+            return;
+        }
         // 出错事件处理与挂断事件处理相同，调用HandleClose函数
         return HandleClose();
     }
 
+    // 从错误队列中取出所有的零拷贝完成通知，释放内核已经不再引用的数据，错误队列中有其他错误时返回false
+    bool ReapZeroCopy()
+    {
+        uint32_t lo = 0, hi = 0;
+        int ret = 0;
+        while ((ret = _socket.RecvZeroCopyNotify(&lo, &hi)) > 0)
+        {
+            // 序号是32位循环计数的，用差值比较区间
+            for (auto &pending : _zerocopy_pending)
+            {
+                if ((int32_t)(pending._seq - lo) >= 0 && (int32_t)(hi - pending._seq) >= 0)
+                    pending._done = true;
+            }
+            while (_zerocopy_pending.empty() == false && _zerocopy_pending.front()._done)
+            {
+                _zerocopy_pending.pop_front();
+            }
+        }
+        return ret == 0;
+    }
+
     // 描述符触发任意事件: 1. 刷新连接的活跃度 -- 延迟定时销毁任务；  2. 调用组件使用者的任意事件回调
     void HandleEvent()
     {
         if (_enable_inactive_release == true)
         {
-            // 若启用了非活跃销毁，刷新连接的定时器
-            _loop->TimerRefresh(_conn_id);
+            // 若启用了非活跃销毁，记录连接的活跃时间，定时器到期时据此顺延
+            _inactive_timer.Touch(_loop->TimerNow());
         }
         if (_event_callback)
         {
@@ -173,7 +370,12 @@ private:
         // 当前函数执行完毕，则连接进入已完成连接状态
         _statu = CONNECTED;           
         // 一旦启动读事件监控就有可能会立即触发读事件，如果这时候启动了非活跃连接销毁
-        _channel.EnableRead();
+        // 边缘触发模式下写事件从一开始就处于监控中，之后不再开关
+        if (_edge_triggered)
+            _channel.EnableWrite();
+        // 如果在连接就绪之前发送的数据已经超过了高水位线，则暂不启动读事件监控
+        if (_read_paused == false)
+            _channel.EnableRead();
         if (_connected_callback)
         {
             // 若设置了连接建立成功回调函数，调用该函数
@@ -184,6 +386,11 @@ private:
     // 这个接口才是实际的释放接口
     void ReleaseInLoop()
     {
+        // 同一个连接可能从多条路径被释放（例如发送完毕和可写事件同时发现连接待关闭），只处理第一次
+        if (_statu == DISCONNECTED)
+        {
+            return;
+        }
         // 1. 修改连接状态，将其置为DISCONNECTED
         _statu = DISCONNECTED;
         // 2. 移除连接的事件监控
@@ -191,11 +398,12 @@ private:
         // 3. 关闭描述符
         _socket.Close();
         // 4. 如果当前定时器队列中还有定时销毁任务，则取消任务
-        if (_loop->HasTimer(_conn_id))
+        if (_inactive_timer.Pending())
         {
             // 取消非活跃销毁任务
             CancelInactiveReleaseInLoop();
         }
+        _loop->TimerStop(&_stall_timer);
         // 5. 调用关闭回调函数，避免先移除服务器管理的连接信息导致Connection被释放，再去处理会出错，因此先调用用户的回调函数
         if (_closed_callback)
         {
@@ -210,21 +418,155 @@ private:
         }
     }
 
-    // 这个接口并不是实际的发送接口，而只是把数据放到了发送缓冲区，启动了可写事件监控
-    void SendInLoop(Buffer &buf)
+    // 这个接口并不是实际的发送接口，而只是把数据块挂到了发送缓冲区链上，启动了可写事件监控
+    // owner 持有数据的所有权，数据块在发送完毕之前会一直持有它
+    void SendInLoop(const std::shared_ptr<void> &owner, const char *data, uint64_t len)
     {
         if (_statu == DISCONNECTED)
         {
             // 若连接已关闭，直接返回
             return;
         }
-        // 将数据写入输出缓冲区
-        _out_buffer.WriteAndPush(buf);
-        if (_channel.WriteAble() == false)
+        // 将数据块直接挂到输出缓冲区链上，不再拷贝
+        _out_buffer.Append(owner, data, len);
+        WantWrite();
+        // 待发送数据超过高水位线，暂停读事件监控
+        CheckHighWaterMark();
+    }
+
+    // 有新的数据待发送：水平触发模式下启动写事件监控
+    // 边缘触发模式下写事件一直在监控中，但是空闲的套接字不会再报告可写，因此安排在本轮事件循环的最后统一发送一次，
+    // 同一轮中多次发送的数据（例如响应头部和正文）仍然合并到一次sendmsg中
+    void WantWrite()
+    {
+        if (_edge_triggered == false)
         {
-            // 若写事件未启用，启用写事件监控
-            _channel.EnableWrite();
+            if (_channel.WriteAble() == false)
+            {
+                // 若写事件未启用，启用写事件监控
+                _channel.EnableWrite();
+            }
+            return;
         }
+        if (_flush_queued == false)
+        {
+            _flush_queued = true;
+            _loop->QueueInLoop(std::bind(&Connection::FlushInLoop, shared_from_this()));
+        }
+    }
+
+    // 边缘触发模式下，发送本轮事件循环中积累的数据，发送缓冲区写满之后由可写事件继续发送
+    void FlushInLoop()
+    {
+        _flush_queued = false;
+        if (_statu == DISCONNECTED)
+        {
+            return;
+        }
+        HandleWrite();
+    }
+
+    // 边缘触发模式下，继续读取上一次因为达到接收上限而没有读完的数据
+    void ReadAgainInLoop()
+    {
+        if (_statu != CONNECTED || _read_paused)
+        {
+            // 暂停读期间不读，恢复读事件监控时epoll会重新检查并报告可读
+            return;
+        }
+        HandleRead();
+    }
+
+    // 待发送数据超过高水位线时，暂停读事件监控，不再接收会产生更多输出的请求，并通知组件使用者
+    void CheckHighWaterMark()
+    {
+        if (_high_water_mark == 0 || _read_paused || _out_buffer.ReadAbleSize() < _high_water_mark)
+        {
+            return;
+        }
+        _read_paused = true;
+        if (_channel.ReadAble())
+        {
+            _channel.DisableRead();
+        }
+        // 从暂停时开始计算写停滞时间
+        _last_send_time = _loop->MonotonicMs();
+        if (_write_stall_timeout > 0 && _stall_timer.Pending() == false)
+        {
+            _loop->TimerStart(&_stall_timer, (uint64_t)_write_stall_timeout * 1000);
+        }
+        if (_high_water_callback)
+        {
+            _high_water_callback(shared_from_this(), _out_buffer.ReadAbleSize());
+        }
+    }
+
+    // 待发送数据回落到低水位线以下时，恢复读事件监控，并通知组件使用者
+    void CheckLowWaterMark()
+    {
+        if (_read_paused == false || _out_buffer.ReadAbleSize() > _low_water_mark)
+        {
+            return;
+        }
+        _read_paused = false;
+        if (_statu == CONNECTED && _channel.ReadAble() == false)
+        {
+            _channel.EnableRead();
+        }
+        if (_low_water_callback)
+        {
+            _low_water_callback(shared_from_this());
+        }
+        // 暂停期间组件使用者可能留下了已接收但还没有处理的数据，恢复之后继续处理
+        if (_statu == CONNECTED && _in_buffer.ReadAbleSize() > 0)
+        {
+            _message_callback(shared_from_this(), &_in_buffer);
+        }
+    }
+
+    // 写停滞检测定时任务：暂停读之后超过超时时间没有发出任何数据，说明对端不再接收数据，释放连接
+    // 定时器是连接的成员，连接释放时会停止，因此这里不需要检查连接是否还存在
+    void CheckWriteStall()
+    {
+        if (_statu == DISCONNECTED || _read_paused == false)
+        {
+            // 已经恢复正常，不再需要检测
+            return;
+        }
+        uint64_t timeout = (uint64_t)_write_stall_timeout * 1000;
+        uint64_t idle = _loop->MonotonicMs() - _last_send_time;
+        if (idle >= timeout)
+        {
+            LOG(DEBUG, "CONNECTION %p WRITE STALLED, RELEASE\n", this);
+            return Release();
+        }
+        // 期间有发送进度，继续检测剩余的时间
+        _loop->TimerStart(&_stall_timer, timeout - idle);
+    }
+
+    // 发送一段由 owner 持有的数据，在EventLoop线程中直接挂链，否则只把引用计数传递给EventLoop线程
+    void SendOwned(const std::shared_ptr<void> &owner, const char *data, uint64_t len)
+    {
+        if (len == 0)
+            return;
+        if (_loop->IsInLoop())
+        {
+            // 在自己的线程中直接挂链，省去构造任务对象的开销
+            return SendInLoop(owner, data, len);
+        }
+        _loop->QueueInLoop(std::bind(&Connection::SendInLoop, this, owner, data, len));
+    }
+
+    // 把文件数据块挂到发送缓冲区链上，启动可写事件监控
+    void SendFileInLoop(const PtrFile &file, off_t offset, uint64_t len)
+    {
+        if (_statu == DISCONNECTED || len == 0)
+        {
+            return;
+        }
+        _out_buffer.AppendFile(file, offset, len);
+        WantWrite();
+        CheckHighWaterMark();
     }
 
     // 这个关闭操作并非实际的连接释放操作，需要判断还有没有数据待处理，待发送
@@ -243,32 +585,32 @@ private:
         // 要么就是写入数据的时候出错关闭，要么就是没有待发送数据，直接关闭
         if (_out_buffer.ReadAbleSize() > 0)
         {
-            if (_channel.WriteAble() == false)
-            {
-                // 若写事件未启用，启用写事件监控
-                _channel.EnableWrite();
-            }
+            // 还有待发送的数据，确保它们会被发送出去
+            WantWrite();
         }
-        if (_out_buffer.ReadAbleSize() == 0)
+        if (_out_buffer.ReadAbleSize() == 0 && _zerocopy_pending.empty() && _pending_works == 0)
         {
-            // 若输出缓冲区没有数据，调用Release函数进行释放
+            // 若输出缓冲区没有数据，零拷贝发送都已完成，并且没有异步处理在进行，调用Release函数进行释放
             Release();
         }
     }
 
+    // 重新处理输入缓冲区中已经接收但还没有处理的数据；对端已经半关闭时，关闭前收到的请求也要处理完
+    void ResumeMessageInLoop()
+    {
+        if (_statu != DISCONNECTED && _in_buffer.ReadAbleSize() > 0 && _message_callback)
+        {
+            _message_callback(shared_from_this(), &_in_buffer);
+        }
+    }
+
     // 启动非活跃连接超时释放规则
     void EnableInactiveReleaseInLoop(int sec)
     {
         // 1. 将判断标志 _enable_inactive_release 置为true
         _enable_inactive_release = true;
-        // 2. 如果当前定时销毁任务已经存在，那就刷新延迟一下即可
-        if (_loop->HasTimer(_conn_id))
-        {
-            // 刷新连接的定时器
-            return _loop->TimerRefresh(_conn_id);
-        }
-        // 3. 如果不存在定时销毁任务，则新增
-        _loop->TimerAdd(_conn_id, sec, std::bind(&Connection::Release, this));
+        // 2. 启动定时销毁任务，如果已经存在，则按照新的超时时间重新计时
+        _loop->TimerStart(&_inactive_timer, (uint64_t)sec * 1000);
     }
 
     // 取消非活跃销毁
@@ -276,11 +618,8 @@ private:
     {
         // 禁用非活跃销毁
         _enable_inactive_release = false;
-        if (_loop->HasTimer(_conn_id))
-        {
-            // 取消连接的定时器
-            _loop->TimerCancel(_conn_id);
-        }
+        // 停止连接的定时器
+        _loop->TimerStop(&_inactive_timer);
     }
 
     // 切换协议 --- 重置上下文以及阶段性回调处理函数 -- 而是这个接口必须在EventLoop线程中立即执行
@@ -306,9 +645,13 @@ private:
 public:
     // 构造函数，初始化连接对象
     Connection(EventLoop *loop, uint64_t conn_id, int sockfd) : _conn_id(conn_id), _sockfd(sockfd),
-                                                                _enable_inactive_release(false), _loop(loop), _statu(CONNECTING), _socket(_sockfd),
+                                                                _enable_inactive_release(false), _read_budget(DEFAULT_READ_BUDGET),
+                                                                _high_water_mark(0), _low_water_mark(0), _read_paused(false),
+                                                                _write_stall_timeout(0), _last_send_time(0), _pending_works(0),
+                                                                _edge_triggered(false), _flush_queued(false), _zerocopy_threshold(0), _zerocopy_seq(0), _loop(loop), _statu(CONNECTING), _socket(_sockfd),
                                                                 _channel(loop, _sockfd)
     {
+        // 连接的套接字必须是非阻塞的（sendfile没有非阻塞标志位），由Acceptor通过accept4在接受时直接设置
         // 设置关闭事件回调函数
         _channel.SetCloseCallback(std::bind(&Connection::HandleClose, this));
         // 设置任意事件回调函数
@@ -319,6 +662,12 @@ public:
         _channel.SetWriteCallback(std::bind(&Connection::HandleWrite, this));
         // 设置出错事件回调函数
         _channel.SetErrorCallback(std::bind(&Connection::HandleError, this));
+        // 定时器是连接的成员，随连接一起释放，回调函数直接绑定this
+        _inactive_timer.SetCallback(std::bind(&Connection::Release, this));
+        _stall_timer.SetCallback(std::bind(&Connection::CheckWriteStall, this));
+        // io_uring 后端下由内核持续接收数据，省去每次可读一次 recvmsg 系统调用
+        if (loop->SupportsMultishot())
+            _channel.SetMultishot(MULTISHOT_RECV);
     }
 
     // 析构函数，打印连接释放信息
@@ -330,9 +679,29 @@ public:
     // 获取连接ID
     int Id() { return _conn_id; }
 
+    // 获取连接所属的EventLoop
+    EventLoop *GetLoop() { return _loop; }
+
     // 判断连接是否处于CONNECTED状态
     bool Connected() { return (_statu == CONNECTED); }
 
+    // 判断连接是否已经释放
+    bool Disconnected() { return (_statu == DISCONNECTED); }
+
+    // 调整连接上还没有完成的异步处理数量，只能在连接所属的 EventLoop 线程中调用
+    // 最后一个处理完成时，如果连接待关闭并且数据都已经发送完毕，就释放连接
+    void AddPendingWork(int delta)
+    {
+        _pending_works += delta;
+        if (_pending_works == 0 && _statu == DISCONNECTING && _out_buffer.ReadAbleSize() == 0 && _zerocopy_pending.empty())
+        {
+            Release();
+        }
+    }
+
+    // 判断待发送数据是否超过了高水位线，超过时组件使用者应当暂停处理已接收的数据，等回落之后会再次调用_message_callback
+    bool OverHighWaterMark() { return _read_paused; }
+
     // 设置上下文 -- 连接建立完成时进行调用
     void SetContext(const Any &context) { _context = context; }
 
@@ -351,6 +720,50 @@ public:
     // 设置任意事件回调函数
     void SetAnyEventCallback(const AnyEventCallback &cb) { _event_callback = cb; }
 
+    // 设置一次可读事件中最多接收的数据量
+    void SetReadBudget(uint64_t budget) { _read_budget = budget; }
+
+    // 设置输出高低水位线：待发送数据超过high时暂停读，回落到low以下时恢复读，high为0表示不限制
+    void SetWaterMarks(uint64_t high, uint64_t low)
+    {
+        _high_water_mark = high;
+        _low_water_mark = low < high ? low : high / 2;
+    }
+
+    // 设置超过高水位线时的回调函数
+    void SetHighWaterMarkCallback(const HighWaterMarkCallback &cb) { _high_water_callback = cb; }
+
+    // 设置回落到低水位线时的回调函数
+    void SetLowWaterMarkCallback(const LowWaterMarkCallback &cb) { _low_water_callback = cb; }
+
+    // 设置写停滞超时时间（秒），暂停读之后超过这个时间没有发出任何数据就释放连接
+    void SetWriteStallTimeout(int sec) { _write_stall_timeout = sec; }
+
+    // 设置套接字的TCP_NOTSENT_LOWAT，让内核中未发送的数据也保持在较低水平
+    void SetNotSentLowat(int bytes) { _socket.SetNotSentLowat(bytes); }
+
+    // 设置连接套接字的SO_BUSY_POLL，尽力而为，内核或者权限不支持时忽略
+    void SetBusyPoll(int usec) { _socket.SetBusyPoll(usec); }
+
+    // 开启边缘触发模式，需要在连接就绪之前设置：读写都进行到EAGAIN为止，写事件一直保持监控，
+    // 省去部分读取后的重复唤醒以及每个响应前后开关写事件的epoll_ctl调用
+    void EnableEdgeTriggered()
+    {
+        _edge_triggered = true;
+        _channel.EnableEdgeTriggered();
+    }
+
+    // 开启零拷贝发送，不小于threshold的内存数据块使用MSG_ZEROCOPY发送，内核不支持时保持普通发送
+    // 零拷贝发送省去了大块数据拷贝到内核的开销，但是需要额外回收完成通知，只适合大的响应
+    void EnableZeroCopy(uint64_t threshold = DEFAULT_ZEROCOPY_THRESHOLD)
+    {
+        if (threshold == 0 || _socket.EnableZeroCopy() == false)
+        {
+            return;
+        }
+        _zerocopy_threshold = threshold;
+    }
+
     // 设置服务器内部的连接关闭回调函数
     void SetSrvClosedCallback(const ClosedCallback &cb) { _server_closed_callback = cb; }
 
@@ -366,12 +779,45 @@ public:
     {
         // 外界传入的data，可能是个临时的空间，我们现在只是把发送操作压入了任务池，有可能并没有被立即执行
         // 因此有可能执行的时候，data指向的空间有可能已经被释放了。
-        // 创建一个临时缓冲区
-        Buffer buf;
-        // 将数据写入临时缓冲区
-        buf.WriteAndPush(data, len);
-        // 将SendInLoop函数放入EventLoop的任务队列中执行
-        _loop->RunInLoop(std::bind(&Connection::SendInLoop, this, std::move(buf)));
+        // 把数据拷贝一次到一个共享数据中，之后的传递都只是引用计数
+        if (len == 0)
+            return;
+        Send(std::make_shared<const std::string>(data, len));
+    }
+
+    // 发送一个字符串，字符串的空间直接挂到发送缓冲区链上，不拷贝数据
+    void Send(std::string &&data)
+    {
+        if (data.empty())
+            return;
+        // 字符串移动到堆上，内部的数据空间保持不变
+        std::shared_ptr<std::string> owner = std::make_shared<std::string>(std::move(data));
+        SendOwned(owner, owner->data(), owner->size());
+    }
+
+    // 发送一个缓冲区中的可读数据，缓冲区的空间直接挂到发送缓冲区链上，不拷贝数据
+    void Send(Buffer &&buf)
+    {
+        if (buf.ReadAbleSize() == 0)
+            return;
+        // 缓冲区对象移动到堆上，内部的数据空间保持不变
+        std::shared_ptr<Buffer> owner = std::make_shared<Buffer>(std::move(buf));
+        SendOwned(owner, owner->ReadPosition(), owner->ReadAbleSize());
+    }
+
+    // 发送一份共享数据，同一份数据可以发送给任意多个连接，每个连接只增加一次引用计数
+    void Send(const SharedPayload &payload)
+    {
+        if (!payload)
+            return;
+        SendOwned(std::const_pointer_cast<std::string>(payload), payload->data(), payload->size());
+    }
+
+    // 发送文件中从 offset 开始的 len 字节，数据由内核通过sendfile直接发送，不经过用户空间
+    // 文件数据块排在之前发送的数据之后，连接会持有文件的引用直到发送完毕
+    void SendFile(const PtrFile &file, off_t offset, uint64_t len)
+    {
+        _loop->RunInLoop(std::bind(&Connection::SendFileInLoop, this, file, offset, len));
     }
 
     // 提供给组件使用者的关闭接口 -- 并不实际关闭，需要判断有没有数据待处理
@@ -381,11 +827,17 @@ public:
         _loop->RunInLoop(std::bind(&Connection::ShutdownInLoop, this));
     }
 
+    // 组件使用者暂停处理输入数据（例如把请求交给计算线程池异步处理）之后，恢复处理输入缓冲区中剩余的数据
+    void ResumeMessage()
+    {
+        _loop->RunInLoop(std::bind(&Connection::ResumeMessageInLoop, shared_from_this()));
+    }
+
     // 实际的释放连接操作
     void Release()
     {
-        // 将ReleaseInLoop函数放入EventLoop的任务队列中执行
-        _loop->QueueInLoop(std::bind(&Connection::ReleaseInLoop, this));
+        // 将ReleaseInLoop函数放入EventLoop的任务队列中执行，任务持有连接的引用，重复的释放任务执行时连接仍然有效
+        _loop->QueueInLoop(std::bind(&Connection::ReleaseInLoop, shared_from_this()));
     }
 
     // 启动非活跃销毁，并定义多长时间无通信就是非活跃，添加定时任务
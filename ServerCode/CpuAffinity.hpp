@@ -0,0 +1,90 @@
+#pragma once
+#include "../Log.hpp"
+#include <vector>
+#include <algorithm>
+#include <sched.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+// 内存分配策略：优先在当前线程所运行 CPU 的本地 NUMA 节点上分配，节点内存不足时再使用其他节点
+#ifndef MPOL_LOCAL
+#define MPOL_LOCAL 4
+#endif
+
+using namespace log_ns;
+
+// CpuAffinity 类负责为 EventLoop 线程规划和绑定 CPU
+// 线程绑定到固定的 CPU 后不会被调度器在核心、插槽之间迁移，缓存和本地内存始终有效；
+// 同时把线程的内存分配策略设置为本地节点，之后在该线程中创建的 EventLoop、缓冲区内存池等都分配在本地 NUMA 节点上
+class CpuAffinity
+{
+public:
+    // 获取 CPU 所属的 NUMA 节点，通过 /sys/devices/system/cpu/cpuN/ 目录下的 nodeM 链接得到，获取失败返回 0
+    static int CpuNode(int cpu)
+    {
+        char path[64];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+        DIR *dir = opendir(path);
+        if (dir == NULL)
+            return 0;
+        int node = 0;
+        struct dirent *ent;
+        while ((ent = readdir(dir)) != NULL)
+        {
+            if (strncmp(ent->d_name, "node", 4) == 0 && isdigit((unsigned char)ent->d_name[4]))
+            {
+                node = atoi(ent->d_name + 4);
+                break;
+            }
+        }
+        closedir(dir);
+        return node;
+    }
+
+    // 获取进程允许运行的 CPU 列表，去掉保留的 CPU（例如留给网卡中断处理的核心）
+    // 结果按 NUMA 节点排序，依次分配时同一个节点上的 CPU 先被用完，线程尽量集中在少数节点上
+    static std::vector<int> AvailableCpus(const std::vector<int> &reserved)
+    {
+        std::vector<int> cpus;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) < 0)
+        {
+            LOG(WARNING, "SCHED GETAFFINITY FAILED:%s\n", strerror(errno));
+            return cpus;
+        }
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        {
+            if (CPU_ISSET(cpu, &set) && std::find(reserved.begin(), reserved.end(), cpu) == reserved.end())
+                cpus.push_back(cpu);
+        }
+        std::vector<std::pair<int, int>> order;
+        for (auto cpu : cpus)
+            order.push_back(std::make_pair(CpuNode(cpu), cpu));
+        std::sort(order.begin(), order.end());
+        for (size_t i = 0; i < order.size(); i++)
+            cpus[i] = order[i].second;
+        return cpus;
+    }
+
+    // 把当前线程绑定到指定的 CPU，并把内存分配策略设置为本地节点，cpu 小于 0 表示不绑定
+    static bool BindCurrentThread(int cpu)
+    {
+        if (cpu < 0)
+            return false;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (ret != 0)
+        {
+            LOG(WARNING, "BIND THREAD TO CPU %d FAILED:%s\n", cpu, strerror(ret));
+            return false;
+        }
+        // 内存策略只是优化，内核不支持（例如没有开启 NUMA）时忽略
+        syscall(__NR_set_mempolicy, MPOL_LOCAL, NULL, 0);
+        return true;
+    }
+};
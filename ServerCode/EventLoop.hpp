@@ -2,11 +2,30 @@
 #include "../Log.hpp"
 #include "Poller.hpp"
 #include "TimerWheel.hpp"
+#include "BufferPool.hpp"
+#include "TaskQueue.hpp"
 #include <mutex>
+#include <atomic>
 #include <thread>
 #include <functional>
+#include <time.h>
 #include <sys/eventfd.h>
 
+// 一轮事件循环中最多执行的任务数量，剩余的任务留到下一轮，避免任务不断产生新任务时饿死IO事件
+#define MAX_TASKS_PER_ROUND 4096
+// 忙轮询连续落空时轮询时间逐次减半，最少减到设定值的 1/2^BUSY_POLL_MIN_SHIFT
+#define BUSY_POLL_MIN_SHIFT 4
+
+// 事件循环在忙轮询模式下的运行统计，时间单位为纳秒
+struct LoopStats
+{
+    uint64_t _spin_ns;     // 忙轮询（不阻塞地检查就绪事件）花费的时间
+    uint64_t _wait_ns;     // 忙轮询落空之后阻塞等待事件花费的时间
+    uint64_t _work_ns;     // 处理就绪事件和执行任务花费的时间
+    uint64_t _spin_hits;   // 忙轮询期间等到了事件的次数
+    uint64_t _spin_misses; // 忙轮询超时、转入阻塞等待的次数
+};
+
 // EventLoop类，负责事件循环、任务调度和定时器管理
 class EventLoop
 {
@@ -21,29 +40,106 @@ private:
     std::unique_ptr<Channel> _event_channel;
     // Poller对象，用于进行所有描述符的事件监控
     Poller _poller;             
-    // 任务池，存储待执行的任务
-    std::vector<Functor> _tasks; 
-    // 互斥锁，用于保证任务池操作的线程安全
-    std::mutex _mutex;           
+    // 任务池，存储待执行的任务，无锁队列，任意线程投递任务都不需要加锁
+    TaskQueue _tasks;
+    // 是否已经写过eventfd并且还没有被本线程处理，一连串的任务投递只需要唤醒一次
+    std::atomic<bool> _wakeup_pending;
+    // 任务池中等待执行的任务数量，用于评估EventLoop的负载
+    std::atomic<int64_t> _pending_tasks;
+    // 分配到本EventLoop上的连接数量，由服务器在分配和移除连接时维护，用于评估EventLoop的负载
+    std::atomic<int64_t> _conn_count;
+    // 本线程的时钟，每轮事件监控返回之后读取一次，本轮中的定时器、日志等都使用这个时间
+    CachedClock _clock;
     // 定时器模块对象，用于管理定时任务
     TimerWheel _timer_wheel;     
+    // 缓冲区内存池，本线程中的缓冲区从这里申请和归还内存
+    BufferPool _buffer_pool;
+    // 是否正在处理就绪事件
+    bool _handling_events;
+    // 推迟到下一轮事件监控之后执行的任务（例如达到接收上限、还没有读完的边缘触发连接），只在本线程中访问
+    // 与任务池分开存放：任务池中的任务在本轮中投递的任务也会在本轮执行，放在那里起不到让出事件循环的作用
+    std::vector<Functor> _next_round;
+    // 是否要求事件循环退出，可以在任意线程中设置
+    std::atomic<bool> _quit;
+    // 忙轮询时间（微秒），阻塞等待事件之前先不阻塞地轮询这么久，为 0 表示不使用忙轮询
+    int _busy_poll_us;
+    // 当前的忙轮询时间，连续落空时逐次减半，等到事件后恢复为设定值
+    int _spin_budget_us;
+    // 忙轮询模式下的运行统计，只在本线程中更新，可以在任意线程中读取
+    std::atomic<uint64_t> _spin_ns;
+    std::atomic<uint64_t> _wait_ns;
+    std::atomic<uint64_t> _work_ns;
+    std::atomic<uint64_t> _spin_hits;
+    std::atomic<uint64_t> _spin_misses;
+
+private:
+    // 获取当前的单调时间，单位为纳秒
+    static uint64_t NowNs()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    }
+
+    // 忙轮询模式下的事件监控：先不阻塞地反复检查就绪事件，超过忙轮询时间仍然没有事件再阻塞等待
+    // 空闲与繁忙交替时，事件往往在忙轮询期间到达，不用经历一次线程休眠和唤醒
+    void BusyPoll(std::vector<Channel *> *actives)
+    {
+        uint64_t begin = NowNs();
+        uint64_t deadline = begin + (uint64_t)_spin_budget_us * 1000;
+        uint64_t now = begin;
+        while (1)
+        {
+            _poller.Poll(actives, 0);
+            now = NowNs();
+            if (actives->empty() == false)
+            {
+                // 等到了事件，恢复完整的忙轮询时间
+                _spin_ns.fetch_add(now - begin, std::memory_order_relaxed);
+                _spin_hits.fetch_add(1, std::memory_order_relaxed);
+                _spin_budget_us = _busy_poll_us;
+                return;
+            }
+            if (now >= deadline)
+            {
+                break;
+            }
+        }
+        // 忙轮询落空，说明当前比较空闲，缩短下一次的忙轮询时间，减少空转占用的CPU
+        _spin_ns.fetch_add(now - begin, std::memory_order_relaxed);
+        _spin_misses.fetch_add(1, std::memory_order_relaxed);
+        int min_budget = _busy_poll_us >> BUSY_POLL_MIN_SHIFT;
+        _spin_budget_us = _spin_budget_us / 2 > min_budget ? _spin_budget_us / 2 : (min_budget > 0 ? min_budget : 1);
+        _poller.Poll(actives, -1);
+        _wait_ns.fetch_add(NowNs() - now, std::memory_order_relaxed);
+    }
+
+    // 在本线程中设置忙轮询时间
+    void SetBusyPollInLoop(int usec)
+    {
+        _busy_poll_us = usec > 0 ? usec : 0;
+        _spin_budget_us = _busy_poll_us;
+    }
 
 public:
     // 执行任务池中的所有任务
     void RunAllTask()
     {
-        // 临时存储任务的向量
-        std::vector<Functor> functor;
+        // 先清除唤醒标志再取任务：之后投递的任务一定会重新写eventfd，不会丢失唤醒
+        // 这里的交换与投递者设置标志的交换同步，投递者在设置标志之前挂上的任务在下面一定能取到
+        _wakeup_pending.exchange(false, std::memory_order_acq_rel);
+        Functor task;
+        int count = 0;
+        while (count < MAX_TASKS_PER_ROUND && _tasks.Pop(&task))
         {
-            // 加锁，确保任务池操作的线程安全
-            std::unique_lock<std::mutex> _lock(_mutex);
-            // 将任务池中的任务交换到临时向量中
-            _tasks.swap(functor);
+            task();
+            count++;
         }
-        // 遍历临时向量，执行其中的每个任务
-        for (auto &f : functor)
+        _pending_tasks.fetch_sub(count, std::memory_order_relaxed);
+        if (count == MAX_TASKS_PER_ROUND)
         {
-            f();
+            // 本轮没有执行完，唤醒下一轮的事件监控，让它立即返回继续执行
+            WakeUp();
         }
         return;
     }
@@ -106,33 +202,120 @@ public:
         return;
     }
 
-    // 构造函数，初始化EventLoop对象
-    EventLoop() : _thread_id(std::this_thread::get_id()),
+    // 唤醒本线程的事件监控，已经有未处理的唤醒时不再重复写eventfd
+    void WakeUp()
+    {
+        if (_wakeup_pending.exchange(true, std::memory_order_acq_rel) == false)
+        {
+            WeakUpEventFd();
+        }
+    }
+
+    // 构造函数，初始化EventLoop对象，backend 指定事件监控使用的后端
+    EventLoop(PollerBackend backend = POLLER_EPOLL) : _thread_id(std::this_thread::get_id()),
                   _event_fd(CreateEventFd()),
                   _event_channel(new Channel(this, _event_fd)),
-                  _timer_wheel(this)
+                  _poller(backend),
+                  _wakeup_pending(false),
+                  _pending_tasks(0),
+                  _conn_count(0),
+                  _timer_wheel(this, &_clock),
+                  _handling_events(false),
+                  _quit(false),
+                  _busy_poll_us(0),
+                  _spin_budget_us(0),
+                  _spin_ns(0),
+                  _wait_ns(0),
+                  _work_ns(0),
+                  _spin_hits(0),
+                  _spin_misses(0)
     {
         // 为eventfd的Channel对象设置可读事件的回调函数
         _event_channel->SetReadCallback(std::bind(&EventLoop::ReadEventfd, this));
         // 启动eventfd的读事件监控
         _event_channel->EnableRead();
+        // EventLoop在所属线程中构造，把内存池设置为本线程的缓冲区内存来源
+        BufferPool::Current() = &_buffer_pool;
+        // 本线程的日志使用EventLoop缓存的时间
+        CachedClock::Current() = &_clock;
     }
 
-    // 启动事件循环，包括事件监控、事件处理和任务执行
+    // 析构函数，解除本线程与内存池的关联，关闭eventfd
+    ~EventLoop()
+    {
+        if (BufferPool::Current() == &_buffer_pool)
+        {
+            BufferPool::Current() = NULL;
+        }
+        if (CachedClock::Current() == &_clock)
+        {
+            CachedClock::Current() = NULL;
+        }
+        _event_channel->Remove();
+        close(_event_fd);
+    }
+
+    // 启动事件循环，包括事件监控、事件处理和任务执行，直到调用 Quit 为止
     void Start()
     {
-        while (1)
+        // 运行期间使用缓存的时间，每轮只读取一次时钟
+        _clock.SetCaching(true);
+        while (_quit.load(std::memory_order_acquire) == false)
         {
             // 1. 事件监控，获取所有就绪的Channel对象
             std::vector<Channel *> actives;
-            _poller.Poll(&actives);
+            bool busy = _busy_poll_us > 0;
+            if (_next_round.empty() == false)
+                _poller.Poll(&actives, 0); // 有推迟的任务等着执行，不能阻塞
+            else if (busy)
+                BusyPoll(&actives);
+            else
+                _poller.Poll(&actives);
+            // 事件监控可能阻塞了很久，返回之后更新时钟
+            _clock.Update();
+            uint64_t start = busy ? NowNs() : 0;
             // 2. 事件处理，调用每个就绪Channel的事件处理函数
+            _handling_events = true;
             for (auto &channel : actives)
             {
                 channel->HandleEvent();
             }
+            // 执行上一轮推迟的任务，其他连接已经在上面得到了处理；任务中再次推迟的任务留到下一轮
+            if (_next_round.empty() == false)
+            {
+                std::vector<Functor> tasks;
+                tasks.swap(_next_round);
+                for (auto &task : tasks)
+                {
+                    task();
+                }
+            }
+            _handling_events = false;
             // 3. 执行任务池中的所有任务
             RunAllTask();
+            if (busy)
+                _work_ns.fetch_add(NowNs() - start, std::memory_order_relaxed);
+        }
+        _clock.SetCaching(false);
+        // 推迟的任务不再执行，其中持有的连接等对象在本线程中释放
+        _next_round.clear();
+        // 退出前执行完已经投递的任务，任务中持有的连接等对象在本线程中释放
+        Functor task;
+        while (_tasks.Pop(&task))
+        {
+            task();
+            _pending_tasks.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    // 要求事件循环退出，可以在任意线程中调用；事件循环执行完当前一轮后从 Start 返回
+    // 调用前应当先关闭本 EventLoop 上的所有连接，退出之后不能再向它投递任务
+    void Quit()
+    {
+        _quit.store(true, std::memory_order_release);
+        if (IsInLoop() == false)
+        {
+            WakeUp();
         }
     }
 
@@ -157,32 +340,103 @@ public:
         }
         return QueueInLoop(cb);
     }
+    void RunInLoop(Functor &&cb)
+    {
+        if (IsInLoop())
+        {
+            return cb();
+        }
+        return QueueInLoop(std::move(cb));
+    }
 
     // 将任务加入任务池，并唤醒可能阻塞的线程
     void QueueInLoop(const Functor &cb)
     {
+        _tasks.Push(cb);
+        _pending_tasks.fetch_add(1, std::memory_order_relaxed);
+        WakeUpAfterQueue();
+    }
+    // 右值版本，任务对象直接移动到任务池中，不拷贝绑定的参数
+    void QueueInLoop(Functor &&cb)
+    {
+        _tasks.Push(std::move(cb));
+        _pending_tasks.fetch_add(1, std::memory_order_relaxed);
+        WakeUpAfterQueue();
+    }
+
+    // 把任务推迟到下一轮事件监控之后执行，期间先处理其他就绪的事件，只能在本线程中调用
+    void QueueNextRound(Functor &&cb)
+    {
+        assert(IsInLoop());
+        _next_round.push_back(std::move(cb));
+    }
+
+    // 投递任务之后唤醒可能阻塞的线程
+    void WakeUpAfterQueue()
+    {
+        // 在本线程的事件处理过程中加入的任务，处理完事件之后马上就会执行，不需要唤醒
+        // 其他情况（例如执行任务的过程中加入的任务要等下一轮）仍然需要唤醒，避免阻塞在事件监控中
+        if (IsInLoop() && _handling_events)
         {
-            // 加锁，确保任务池操作的线程安全
-            std::unique_lock<std::mutex> _lock(_mutex);
-            // 将任务加入任务池
-            _tasks.push_back(cb);
+            return;
         }
         // 唤醒可能因没有事件就绪而阻塞的线程
-        WeakUpEventFd();
+        WakeUp();
+    }
+
+    // 获取任务池中等待执行的任务数量，可以在任意线程中调用，结果是近似值
+    int64_t PendingTasks() { return _pending_tasks.load(std::memory_order_relaxed); }
+    // 获取分配到本EventLoop上的连接数量，可以在任意线程中调用
+    int64_t ConnectionCount() { return _conn_count.load(std::memory_order_relaxed); }
+    // 调整分配到本EventLoop上的连接数量，delta为1表示分配了一个连接，为-1表示移除了一个连接
+    void AddConnectionCount(int delta) { _conn_count.fetch_add(delta, std::memory_order_relaxed); }
+
+    // 本轮事件循环开始时的单调时钟（毫秒），只能在EventLoop线程中调用
+    uint64_t MonotonicMs() { return _clock.MonotonicMs(); }
+    // 本轮事件循环开始时的系统时钟（秒），只能在EventLoop线程中调用
+    time_t WallTime() { return _clock.WallTime(); }
+    // 本轮事件循环开始时的格式化时间（年-月-日 时:分:秒），按秒缓存，只能在EventLoop线程中调用
+    const char *FormattedTime() { return _clock.FormattedTime(); }
+
+    // 设置忙轮询时间（微秒），每次阻塞等待事件之前先忙轮询这么久，为 0 表示关闭，可以在任意线程中调用
+    void SetBusyPoll(int usec) { RunInLoop(std::bind(&EventLoop::SetBusyPollInLoop, this, usec)); }
+    // 获取忙轮询模式下的运行统计，可以在任意线程中调用
+    void GetStats(LoopStats *stats)
+    {
+        stats->_spin_ns = _spin_ns.load(std::memory_order_relaxed);
+        stats->_wait_ns = _wait_ns.load(std::memory_order_relaxed);
+        stats->_work_ns = _work_ns.load(std::memory_order_relaxed);
+        stats->_spin_hits = _spin_hits.load(std::memory_order_relaxed);
+        stats->_spin_misses = _spin_misses.load(std::memory_order_relaxed);
     }
 
     // 添加或修改描述符的事件监控
     void UpdateEvent(Channel *channel) { return _poller.UpdateEvent(channel); }
     // 移除描述符的事件监控
     void RemoveEvent(Channel *channel) { return _poller.RemoveEvent(channel); }
-    // 添加一个定时任务
-    void TimerAdd(uint64_t id, uint32_t delay, const TaskFunc &cb) { return _timer_wheel.TimerAdd(id, delay, cb); }
-    // 刷新/延迟定时任务
-    void TimerRefresh(uint64_t id) { return _timer_wheel.TimerRefresh(id); }
-    // 取消定时任务
-    void TimerCancel(uint64_t id) { return _timer_wheel.TimerCancel(id); }
-    // 判断是否存在指定ID的定时任务
-    bool HasTimer(uint64_t id) { return _timer_wheel.HasTimer(id); }
+    // 事件监控后端是否支持 Channel 的多次触发操作（io_uring 后端并且内核支持），可以在任意线程中调用
+    bool SupportsMultishot() { return _poller.SupportsMultishot(); }
+    // 在读事件回调中取走多次触发 accept 接受的新连接，返回接受过程中遇到的错误码，没有错误返回 0
+    int TakeAccepted(Channel *channel, std::vector<int> *fds) { return _poller.TakeAccepted(channel, fds); }
+    // 在读事件回调中取走多次触发 recv 收到的数据，依次交给 cb，返回数据量，-1 表示对端关闭或出错
+    ssize_t TakeReceived(Channel *channel, const std::function<void(const char *, size_t)> &cb)
+    {
+        return _poller.TakeReceived(channel, cb);
+    }
+    // 添加一个 delay 毫秒之后执行一次的定时任务，返回用于取消的句柄，可以在任意线程中调用
+    TimerId RunAfter(uint64_t delay, const TaskFunc &cb) { return _timer_wheel.RunAfter(delay, cb); }
+    // 添加一个每隔 interval 毫秒执行一次的定时任务，第一次在 interval 毫秒之后执行，可以在任意线程中调用
+    TimerId RunEvery(uint64_t interval, const TaskFunc &cb) { return _timer_wheel.RunEvery(interval, interval, cb); }
+    // 取消本 EventLoop 的 RunAfter/RunEvery 添加的定时任务，可以在任意线程中调用；其他 EventLoop 的句柄会被忽略
+    void Cancel(TimerId id) { return _timer_wheel.Cancel(id); }
+    // 设置定时器合并时间（毫秒），定时器最多推迟这么久执行，换取更少的唤醒次数，可以在任意线程中调用
+    void SetTimerSlack(uint64_t slack) { return _timer_wheel.SetSlack(slack); }
+    // 启动/重新启动一个定时器节点，超时时间单位为毫秒，只能在EventLoop线程中调用
+    void TimerStart(TimerNode *node, uint64_t delay) { return _timer_wheel.TimerStart(node, delay); }
+    // 停止一个定时器节点，只能在EventLoop线程中调用
+    void TimerStop(TimerNode *node) { return _timer_wheel.TimerStop(node); }
+    // 定时器的当前时间（毫秒），用于 TimerNode::Touch 记录活跃时间
+    uint64_t TimerNow() { return _timer_wheel.Now(); }
 };
 
 // Channel类的Remove方法实现，调用EventLoop的RemoveEvent方法移除事件监控
@@ -190,20 +444,30 @@ void Channel::Remove() { return _loop->RemoveEvent(this); }
 // Channel类的Update方法实现，调用EventLoop的UpdateEvent方法更新事件监控
 void Channel::Update() { return _loop->UpdateEvent(this); }
 
-// TimerWheel类的TimerAdd方法实现，将定时器添加操作封装到任务中，在EventLoop线程中执行
-void TimerWheel::TimerAdd(uint64_t id, uint32_t delay, const TaskFunc &cb)
+// TimerWheel类的RunEvery方法实现，先分配序号作为句柄返回，添加操作封装到任务中，在EventLoop线程中执行
+TimerId TimerWheel::RunEvery(uint64_t delay, uint64_t interval, const TaskFunc &cb)
 {
-    _loop->RunInLoop(std::bind(&TimerWheel::TimerAddInLoop, this, id, delay, cb));
+    uint64_t seq = ++_next_seq;
+    _loop->RunInLoop(std::bind(&TimerWheel::RunAddInLoop, this, seq, delay, interval, cb));
+    return TimerId(this, seq);
 }
 
-// 刷新/延迟定时任务，将操作封装到任务中，在EventLoop线程中执行
-void TimerWheel::TimerRefresh(uint64_t id)
+// 设置定时器合并时间，将操作封装到任务中，在EventLoop线程中执行
+void TimerWheel::SetSlack(uint64_t slack)
 {
-    _loop->RunInLoop(std::bind(&TimerWheel::TimerRefreshInLoop, this, id));
+    _loop->RunInLoop(std::bind(&TimerWheel::SetSlackInLoop, this, slack));
 }
 
-// 取消定时任务，将操作封装到任务中，在EventLoop线程中执行
-void TimerWheel::TimerCancel(uint64_t id)
+// 取消定时任务，将操作封装到任务中，在EventLoop线程中执行；和添加操作经过同一个任务队列，不会先于添加执行
+void TimerWheel::Cancel(TimerId id)
 {
-    _loop->RunInLoop(std::bind(&TimerWheel::TimerCancelInLoop, this, id));
-}
\ No newline at end of file
+    if (id.Valid() == false)
+        return;
+    if (id._wheel != this)
+    {
+        // 句柄属于其他 EventLoop，序号在这里没有意义
+        LOG(WARNING, "CANCEL TIMER OF ANOTHER EVENTLOOP, IGNORED\n");
+        return;
+    }
+    _loop->RunInLoop(std::bind(&TimerWheel::CancelInLoop, this, id._seq));
+}
@@ -0,0 +1,169 @@
+#pragma once
+#include "../Log.hpp"
+#include <vector>
+#include <string>
+#include <unistd.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+
+// 一次交接最多传递的监听套接字数量
+#define MAX_HANDOFF_FDS 64
+// 新进程连接旧进程并等待它发送监听套接字的超时时间（秒），旧进程卡住时不会一直阻塞新进程的启动
+#define HANDOFF_TIMEOUT 5
+
+using namespace log_ns;
+
+// ListenHandoff 类封装了进程之间通过 Unix 域套接字（SCM_RIGHTS）交接监听套接字的操作
+// 旧进程在约定的路径上监听，新进程启动时连接该路径，旧进程把自己所有的监听套接字发送过去后停止接受新连接并排空已有连接
+// 新旧进程持有的是同一个监听套接字，监听队列中的连接不会丢失，也不需要重新 bind，发布新版本时服务不中断
+class ListenHandoff
+{
+public:
+    // 在 path 上创建一个非阻塞的 Unix 域监听套接字，用于接受新进程的交接请求，失败返回 -1
+    static int CreateServer(const std::string &path)
+    {
+        struct sockaddr_un addr;
+        if (path.size() >= sizeof(addr.sun_path))
+        {
+            LOG(ERROR, "HANDOFF PATH TOO LONG:%s\n", path.c_str());
+            return -1;
+        }
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+        {
+            LOG(ERROR, "CREATE HANDOFF SOCKET FAILED:%s\n", strerror(errno));
+            return -1;
+        }
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, path.c_str());
+        // 路径可能是上一个进程留下的，先删除再绑定
+        unlink(path.c_str());
+        // 连接这个路径就能拿走监听套接字并让服务器停止，在开始监听之前把权限收紧到只有属主可以连接
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || chmod(path.c_str(), 0600) < 0 || listen(fd, 1) < 0)
+        {
+            LOG(ERROR, "LISTEN HANDOFF SOCKET FAILED:%s\n", strerror(errno));
+            close(fd);
+            unlink(path.c_str());
+            return -1;
+        }
+        return fd;
+    }
+
+    // 检查 Unix 域套接字对端进程的有效用户是否与本进程相同，只和同一个用户的进程交接监听套接字
+    static bool CheckPeer(int sock)
+    {
+        struct ucred cred;
+        socklen_t len = sizeof(cred);
+        if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0)
+        {
+            LOG(ERROR, "GET HANDOFF PEER CREDENTIALS FAILED:%s\n", strerror(errno));
+            return false;
+        }
+        if (cred.uid != geteuid())
+        {
+            LOG(WARNING, "REJECT HANDOFF FROM PID %d UID %d\n", (int)cred.pid, (int)cred.uid);
+            return false;
+        }
+        return true;
+    }
+
+    // 通过已经连接的 Unix 域套接字发送一组描述符，正文是描述符的数量
+    static bool SendFds(int sock, const std::vector<int> &fds)
+    {
+        if (fds.empty() || fds.size() > MAX_HANDOFF_FDS)
+            return false;
+        uint32_t count = fds.size();
+        struct iovec iov;
+        iov.iov_base = &count;
+        iov.iov_len = sizeof(count);
+        char control[CMSG_SPACE(sizeof(int) * MAX_HANDOFF_FDS)];
+        memset(control, 0, sizeof(control));
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+        memcpy(CMSG_DATA(cmsg), &fds[0], sizeof(int) * fds.size());
+        ssize_t ret;
+        do
+        {
+            ret = sendmsg(sock, &msg, MSG_NOSIGNAL);
+        } while (ret < 0 && errno == EINTR);
+        if (ret != sizeof(count))
+        {
+            LOG(ERROR, "SEND HANDOFF FDS FAILED:%s\n", strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+    // 连接 path 上的旧进程，接收它交接过来的监听套接字
+    // 没有旧进程在监听时返回 false，这是第一次启动的正常情况
+    static bool Receive(const std::string &path, std::vector<int> *fds)
+    {
+        struct sockaddr_un addr;
+        if (path.size() >= sizeof(addr.sun_path))
+            return false;
+        int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (sock < 0)
+            return false;
+        // 连接和接收都设置超时：旧进程卡住或者监听队列已满时放弃交接，自己创建监听套接字
+        struct timeval tv;
+        tv.tv_sec = HANDOFF_TIMEOUT;
+        tv.tv_usec = 0;
+        setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, path.c_str());
+        // 路径上监听的必须是同一个用户的进程，否则接管的监听套接字可能来自其他用户
+        if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 || CheckPeer(sock) == false)
+        {
+            close(sock);
+            return false;
+        }
+        uint32_t count = 0;
+        struct iovec iov;
+        iov.iov_base = &count;
+        iov.iov_len = sizeof(count);
+        char control[CMSG_SPACE(sizeof(int) * MAX_HANDOFF_FDS)];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        ssize_t ret;
+        do
+        {
+            ret = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+        } while (ret < 0 && errno == EINTR);
+        close(sock);
+        if (ret != sizeof(count))
+        {
+            LOG(WARNING, "RECEIVE HANDOFF FDS FAILED:%s\n", ret < 0 ? strerror(errno) : "closed by peer");
+            return false;
+        }
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+                continue;
+            int n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (int i = 0; i < n; i++)
+            {
+                int fd;
+                memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+                fds->push_back(fd);
+            }
+        }
+        return fds->empty() == false;
+    }
+};
@@ -1,6 +1,24 @@
 #pragma once
 #include"EventLoop.hpp"
+#include"CpuAffinity.hpp"
 #include <condition_variable>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+// 新连接分配到从属 EventLoop 的策略
+// BALANCE_ROUND_ROBIN -- 轮询，依次分配
+// BALANCE_LEAST_CONNECTIONS -- 分配给当前连接数最少的 EventLoop，适合长连接负载差异大的场景
+// BALANCE_LEAST_TASKS -- 分配给任务池中积压任务最少的 EventLoop，适合跨线程发送多的场景
+// BALANCE_TWO_CHOICES -- 随机选两个 EventLoop，分配给其中连接数较少的一个，开销固定，效果接近最少连接
+// BALANCE_ADDRESS_HASH -- 按客户端 IP 地址哈希，同一个客户端的连接总是落在同一个 EventLoop 上，有利于缓存亲和
+typedef enum
+{
+    BALANCE_ROUND_ROBIN,
+    BALANCE_LEAST_CONNECTIONS,
+    BALANCE_LEAST_TASKS,
+    BALANCE_TWO_CHOICES,
+    BALANCE_ADDRESS_HASH
+} LoadBalance;
 
 // LoopThread 类用于管理一个单独的线程，该线程运行一个 EventLoop 实例
 class LoopThread
@@ -10,14 +28,18 @@ private:
     std::mutex _mutex;             // 互斥锁，用于保护对 _loop 的访问
     std::condition_variable _cond; // 条件变量，用于线程间的同步
     EventLoop *_loop;              // EventLoop 指针变量，这个对象需要在线程内实例化
+    PollerBackend _backend;        // EventLoop 事件监控使用的后端
+    int _cpu;                      // 线程绑定的 CPU，小于 0 表示不绑定
     std::thread _thread;           // EventLoop 对应的线程
 
 private:
     /*实例化 EventLoop 对象，唤醒_cond上有可能阻塞的线程，并且开始运行EventLoop模块的功能*/
     void ThreadEntry()
     {
+        // 先绑定 CPU，再创建 EventLoop，EventLoop 及其内存池分配在本地 NUMA 节点上
+        CpuAffinity::BindCurrentThread(_cpu);
         // 在新线程中创建一个 EventLoop 实例
-        EventLoop loop;
+        EventLoop loop(_backend);
         {
             // 加锁，确保对 _loop 的访问是线程安全的
             std::unique_lock<std::mutex> lock(_mutex); 
@@ -26,14 +48,14 @@ private:
             // 唤醒所有在 _cond 上等待的线程
             _cond.notify_all(); 
         }
-        // 启动 EventLoop 的事件循环
+        // 启动 EventLoop 的事件循环，退出之后 EventLoop 随线程一起销毁
         loop.Start(); 
     }
 
 public:
     /*创建线程，设定线程入口函数*/
     // 构造函数，初始化 _loop 为 NULL，并创建一个新线程，线程入口函数为 ThreadEntry
-    LoopThread() : _loop(NULL), _thread(std::thread(&LoopThread::ThreadEntry, this)) {}
+    LoopThread(PollerBackend backend = POLLER_EPOLL, int cpu = -1) : _loop(NULL), _backend(backend), _cpu(cpu), _thread(std::thread(&LoopThread::ThreadEntry, this)) {}
 
     /*返回当前线程关联的EventLoop对象指针*/
     EventLoop *GetLoop()
@@ -51,6 +73,16 @@ public:
         // 返回 EventLoop 指针
         return loop; 
     }
+
+    /*让线程中的EventLoop退出，并等待线程结束，之后GetLoop返回的指针不再有效*/
+    void Stop()
+    {
+        GetLoop()->Quit();
+        if (_thread.joinable())
+        {
+            _thread.join();
+        }
+    }
 };
 
 // LoopThreadPool 类用于管理一个 EventLoop 线程池
@@ -60,19 +92,71 @@ private:
     int _thread_count;  // 线程池中的线程数量
     int _next_idx;      // 用于轮询选择下一个 EventLoop 的索引
     EventLoop *_baseloop; // 主线程的 EventLoop
+    PollerBackend _backend; // 从属 EventLoop 事件监控使用的后端
+    LoadBalance _balance; // 新连接分配到从属 EventLoop 的策略
+    uint64_t _rand_state; // 随机选择使用的伪随机数状态，只在分配连接的线程中使用
+    bool _affinity;       // 是否把 EventLoop 线程绑定到 CPU
+    std::vector<int> _cpus;          // 用于绑定的 CPU 列表，为空表示使用进程允许运行的所有 CPU
+    std::vector<int> _reserved_cpus; // 保留不用的 CPU，例如留给网卡中断处理的核心
     std::vector<LoopThread *> _threads; // 存储 LoopThread 对象的指针
     std::vector<EventLoop *> _loops;    // 存储 EventLoop 对象的指针
 
 public:
     // 构造函数，初始化线程数量为 0，索引为 0，并保存主线程的 EventLoop 指针
-    LoopThreadPool(EventLoop *baseloop) : _thread_count(0), _next_idx(0), _baseloop(baseloop) {}
+    LoopThreadPool(EventLoop *baseloop) : _thread_count(0), _next_idx(0), _baseloop(baseloop), _backend(POLLER_EPOLL),
+                                          _balance(BALANCE_ROUND_ROBIN), _rand_state(0x9E3779B97F4A7C15ULL), _affinity(false) {}
 
     // 设置线程池中的线程数量
     void SetThreadCount(int count) { _thread_count = count; }
 
-    // 创建线程池中的所有线程和对应的 EventLoop
+    // 设置从属 EventLoop 事件监控使用的后端，需要在 Create 之前设置
+    void SetPollerBackend(PollerBackend backend) { _backend = backend; }
+
+    // 停止线程池：让所有从属 EventLoop 退出并等待线程结束，需要在主线程中调用
+    // 调用前应当先关闭所有连接，之后 GetLoops 返回空
+    void Stop()
+    {
+        for (auto thread : _threads)
+        {
+            thread->Stop();
+            delete thread;
+        }
+        _threads.clear();
+        _loops.clear();
+    }
+
+    // 设置 EventLoop 线程绑定的 CPU，需要在 Create 之前设置
+    // cpus 为空表示使用进程允许运行的所有 CPU（按 NUMA 节点排序），reserved 中的 CPU 不会被绑定
+    // 主线程绑定列表中的第一个 CPU，从属线程依次绑定之后的 CPU，CPU 不够时循环使用
+    void SetCpuAffinity(const std::vector<int> &cpus, const std::vector<int> &reserved)
+    {
+        _affinity = true;
+        _cpus = cpus;
+        _reserved_cpus = reserved;
+    }
+
+    // 创建线程池中的所有线程和对应的 EventLoop，绑定 CPU 时同时绑定调用线程（主线程）
     void Create()
     {
+        // 规划每个线程绑定的 CPU
+        std::vector<int> plan;
+        if (_affinity)
+        {
+            if (_cpus.empty())
+            {
+                plan = CpuAffinity::AvailableCpus(_reserved_cpus);
+            }
+            else
+            {
+                for (auto cpu : _cpus)
+                {
+                    if (std::find(_reserved_cpus.begin(), _reserved_cpus.end(), cpu) == _reserved_cpus.end())
+                        plan.push_back(cpu);
+                }
+            }
+            if (plan.empty())
+                LOG(WARNING, "NO CPU AVAILABLE FOR AFFINITY, THREADS ARE NOT BOUND\n");
+        }
         // 如果线程数量大于 0
         if (_thread_count > 0)
         {
@@ -82,24 +166,141 @@ public:
             // 循环创建 LoopThread 对象，并获取对应的 EventLoop 指针
             for (int i = 0; i < _thread_count; i++)
             {
-                _threads[i] = new LoopThread();
+                int cpu = plan.empty() ? -1 : plan[(i + 1) % plan.size()];
+                _threads[i] = new LoopThread(_backend, cpu);
                 _loops[i] = _threads[i]->GetLoop();
             }
         }
+        // 从属线程创建之后再绑定主线程，避免从属线程继承主线程的绑定
+        if (plan.empty() == false)
+        {
+            CpuAffinity::BindCurrentThread(plan[0]);
+        }
         return;
     }
 
-    // 轮询选择下一个 EventLoop 指针
-    EventLoop *NextLoop()
+    // 设置新连接分配到从属 EventLoop 的策略
+    void SetLoadBalance(LoadBalance balance) { _balance = balance; }
+
+    // 获取线程池中所有从属 EventLoop 的指针，需要在 Create 之后调用
+    const std::vector<EventLoop *> &GetLoops() { return _loops; }
+
+    // 按照分配策略选择下一个 EventLoop 指针，fd 为新连接的描述符，按地址哈希分配时使用
+    EventLoop *NextLoop(int fd = -1)
     {
-        // 如果线程数量为 0，返回主线程的 EventLoop 指针
-        if (_thread_count == 0)
+        // 如果没有从属线程（线程数量为 0，或者线程池已经停止），返回主线程的 EventLoop 指针
+        if (_loops.empty())
         {
             return _baseloop;
         }
+        switch (_balance)
+        {
+        case BALANCE_LEAST_CONNECTIONS:
+            return LeastLoaded(false);
+        case BALANCE_LEAST_TASKS:
+            return LeastLoaded(true);
+        case BALANCE_TWO_CHOICES:
+            return TwoChoices();
+        case BALANCE_ADDRESS_HASH:
+        {
+            uint64_t hash = 0;
+            if (AddressHash(fd, &hash))
+                return _loops[hash % _thread_count];
+            break;
+        }
+        default:
+            break;
+        }
+        return RoundRobin();
+    }
+
+private:
+    // 轮询选择
+    EventLoop *RoundRobin()
+    {
         // 更新索引，使用取模运算确保索引在有效范围内
         _next_idx = (_next_idx + 1) % _thread_count;
         // 返回下一个 EventLoop 指针
         return _loops[_next_idx];
     }
+
+    // 选择连接数（by_tasks 为 true 时为积压任务数）最少的 EventLoop
+    // 每次从轮询位置开始比较，负载相同时依次分配，而不是总落在第一个上
+    EventLoop *LeastLoaded(bool by_tasks)
+    {
+        _next_idx = (_next_idx + 1) % _thread_count;
+        EventLoop *best = NULL;
+        int64_t best_load = 0;
+        for (int i = 0; i < _thread_count; i++)
+        {
+            EventLoop *loop = _loops[(_next_idx + i) % _thread_count];
+            int64_t load = by_tasks ? loop->PendingTasks() : loop->ConnectionCount();
+            if (best == NULL || load < best_load)
+            {
+                best = loop;
+                best_load = load;
+            }
+        }
+        return best;
+    }
+
+    // 随机选择两个不同的 EventLoop，取连接数较少的一个
+    EventLoop *TwoChoices()
+    {
+        if (_thread_count == 1)
+        {
+            return _loops[0];
+        }
+        int a = NextRandom() % _thread_count;
+        int b = NextRandom() % (_thread_count - 1);
+        if (b >= a)
+            b++;
+        EventLoop *la = _loops[a], *lb = _loops[b];
+        return la->ConnectionCount() <= lb->ConnectionCount() ? la : lb;
+    }
+
+    // xorshift64 伪随机数
+    uint64_t NextRandom()
+    {
+        _rand_state ^= _rand_state << 13;
+        _rand_state ^= _rand_state >> 7;
+        _rand_state ^= _rand_state << 17;
+        return _rand_state;
+    }
+
+    // 计算新连接对端 IP 地址的哈希值（不含端口，同一个客户端的不同连接哈希值相同），获取地址失败返回 false
+    static bool AddressHash(int fd, uint64_t *hash)
+    {
+        if (fd < 0)
+            return false;
+        struct sockaddr_storage addr;
+        socklen_t len = sizeof(addr);
+        if (getpeername(fd, (struct sockaddr *)&addr, &len) < 0)
+            return false;
+        const unsigned char *data = NULL;
+        size_t size = 0;
+        if (addr.ss_family == AF_INET)
+        {
+            data = (const unsigned char *)&((struct sockaddr_in *)&addr)->sin_addr;
+            size = sizeof(struct in_addr);
+        }
+        else if (addr.ss_family == AF_INET6)
+        {
+            data = (const unsigned char *)&((struct sockaddr_in6 *)&addr)->sin6_addr;
+            size = sizeof(struct in6_addr);
+        }
+        else
+        {
+            return false;
+        }
+        // FNV-1a 哈希
+        uint64_t h = 14695981039346656037ULL;
+        for (size_t i = 0; i < size; i++)
+        {
+            h ^= data[i];
+            h *= 1099511628211ULL;
+        }
+        *hash = h;
+        return true;
+    }
 };
\ No newline at end of file
@@ -1,14 +1,25 @@
 #include "../Log.hpp"
 #include "Channel.hpp"
+#include "UringPoller.hpp"
 #include <vector>
+#include <memory>
 #include <cassert>
-#include <unordered_map>
 
 // 定义最大的 epoll 事件数量
 #define MAX_EPOLLEVENTS 1024
 
 using namespace log_ns;
 
+// 事件监控的后端类型
+// POLLER_EPOLL -- 使用 epoll，每次修改监控事件调用一次 epoll_ctl
+// POLLER_URING -- 使用 io_uring，监控事件的修改和等待合并在一次系统调用中批量提交，内核不支持时退回 epoll
+//                 内核支持时，监听套接字和连接的读事件直接由多次触发的 accept/recv 完成，不再逐个调用 accept4/recvmsg
+typedef enum
+{
+    POLLER_EPOLL,
+    POLLER_URING
+} PollerBackend;
+
 // Poller 类用于封装 epoll 的操作，实现对文件描述符的事件监控
 class Poller
 {
@@ -17,8 +28,8 @@ private:
     int _epfd;
     // 用于存储 epoll_wait 返回的就绪事件
     struct epoll_event _evs[MAX_EPOLLEVENTS];
-    // 存储文件描述符和对应的 Channel 对象指针的映射，方便查找和管理
-    std::unordered_map<int, Channel *> _channels;
+    // io_uring 后端，不为空时所有操作都交给它处理
+    std::unique_ptr<UringPoller> _uring;
 
 private:
     // 对 epoll 进行直接操作，包括添加、修改或删除监控事件
@@ -29,8 +40,8 @@ private:
         int fd = channel->Fd();
         // 定义 epoll_event 结构体，用于设置事件信息
         struct epoll_event ev;
-        // 设置事件关联的文件描述符
-        ev.data.fd = fd;
+        // 事件直接关联 Channel 对象指针，就绪时不需要再根据描述符查找
+        ev.data.ptr = channel;
         // 设置需要监控的事件类型，从 Channel 对象中获取
         ev.events = channel->Events();
         // 调用 epoll_ctl 函数进行操作
@@ -43,23 +54,19 @@ private:
         return;
     }
 
-    // 判断一个 Channel 是否已经添加了事件监控
-    bool HasChannel(Channel *channel)
+public:
+    // 构造函数，初始化 epoll 实例，或者按照指定的后端初始化 io_uring 实例
+    Poller(PollerBackend backend = POLLER_EPOLL) : _epfd(-1)
     {
-        // 在 _channels 映射中查找该 Channel 对应的文件描述符
-        auto it = _channels.find(channel->Fd());
-        // 如果未找到，说明该 Channel 未添加监控
-        if (it == _channels.end())
+        if (backend == POLLER_URING)
         {
-            return false;
+            _uring.reset(UringPoller::Create());
+            if (_uring)
+            {
+                return;
+            }
+            LOG(WARNING, "IO_URING UNAVAILABLE, FALLBACK TO EPOLL\n");
         }
-        return true;
-    }
-
-public:
-    // 构造函数，初始化 epoll 实例
-    Poller()
-    {
         // 创建一个 epoll 实例，参数为最大事件数量
         _epfd = epoll_create(MAX_EPOLLEVENTS);
         // 如果创建失败，记录错误日志并退出程序
@@ -70,15 +77,27 @@ public:
         }
     }
 
+    // 析构函数，关闭 epoll 实例
+    ~Poller()
+    {
+        if (_epfd >= 0)
+        {
+            close(_epfd);
+        }
+    }
+
     // 添加或修改监控事件
     void UpdateEvent(Channel *channel)
     {
-        // 检查该 Channel 是否已经添加了事件监控
-        bool ret = HasChannel(channel);
-        if (ret == false)
+        if (_uring)
+        {
+            return _uring->UpdateEvent(channel);
+        }
+        // 检查该 Channel 是否已经添加了事件监控，注册状态直接记录在 Channel 上
+        if (channel->Registered() == false)
         {
-            // 如果未添加，则将该 Channel 插入到 _channels 映射中
-            _channels.insert(std::make_pair(channel->Fd(), channel));
+            // 如果未添加，则标记为已添加
+            channel->SetRegistered(true);
             // 调用 Update 函数，使用 EPOLL_CTL_ADD 操作添加监控事件
             return Update(channel, EPOLL_CTL_ADD);
         }
@@ -89,23 +108,42 @@ public:
     // 移除监控
     void RemoveEvent(Channel *channel)
     {
-        // 在 _channels 映射中查找该 Channel 对应的文件描述符
-        auto it = _channels.find(channel->Fd());
-        // 如果找到，则从映射中移除该元素
-        if (it != _channels.end())
+        if (_uring)
         {
-            _channels.erase(it);
+            return _uring->RemoveEvent(channel);
         }
+        // 没有添加过监控的 Channel 不需要移除
+        if (channel->Registered() == false)
+        {
+            return;
+        }
+        channel->SetRegistered(false);
         // 调用 Update 函数，使用 EPOLL_CTL_DEL 操作移除监控事件
         Update(channel, EPOLL_CTL_DEL);
     }
 
-    // 开始监控，返回活跃连接
-    void Poll(std::vector<Channel *> *active)
+    // 是否支持 Channel 的多次触发操作，只有 io_uring 后端并且内核支持时为 true
+    bool SupportsMultishot() { return _uring && _uring->SupportsMultishot(); }
+
+    // 取走监听套接字多次触发 accept 接受的新连接，返回接受过程中遇到的错误码，只在支持多次触发操作时调用
+    int TakeAccepted(Channel *channel, std::vector<int> *fds) { return _uring->TakeAccepted(channel, fds); }
+
+    // 取走连接多次触发 recv 收到的数据，返回数据量，-1 表示对端关闭或出错，只在支持多次触发操作时调用
+    ssize_t TakeReceived(Channel *channel, const std::function<void(const char *, size_t)> &cb)
+    {
+        return _uring->TakeReceived(channel, cb);
+    }
+
+    // 开始监控，返回活跃连接，timeout 为等待时间（毫秒），-1 表示无限等待，0 表示只检查一次不等待
+    void Poll(std::vector<Channel *> *active, int timeout = -1)
     {
+        if (_uring)
+        {
+            return _uring->Poll(active, timeout == 0);
+        }
         // epoll_wait 函数的原型：int epoll_wait(int epfd, struct epoll_event *evs, int maxevents, int timeout)
-        // 调用 epoll_wait 函数进行事件监控，-1 表示无限等待
-        int nfds = epoll_wait(_epfd, _evs, MAX_EPOLLEVENTS, -1);
+        // 调用 epoll_wait 函数进行事件监控
+        int nfds = epoll_wait(_epfd, _evs, MAX_EPOLLEVENTS, timeout);
         // 如果调用失败
         if (nfds < 0)
         {
@@ -121,14 +159,12 @@ public:
         // 遍历所有就绪的事件
         for (int i = 0; i < nfds; i++)
         {
-            // 在 _channels 映射中查找该事件对应的 Channel 对象
-            auto it = _channels.find(_evs[i].data.fd);
-            // 确保该 Channel 对象存在
-            assert(it != _channels.end());
+            // 事件中保存的就是 Channel 对象指针
+            Channel *channel = (Channel *)_evs[i].data.ptr;
             // 设置该 Channel 对象实际就绪的事件
-            it->second->SetREvents(_evs[i].events);
+            channel->SetREvents(_evs[i].events);
             // 将该 Channel 对象添加到活跃连接列表中
-            active->push_back(it->second);
+            active->push_back(channel);
         }
         return;
     }
@@ -4,8 +4,24 @@
 #include <cassert>
 #include <stdint.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <fcntl.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <linux/errqueue.h>
+
+// 旧版本的头文件中可能没有零拷贝发送相关的定义
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
 
 using namespace log_ns;
 
@@ -113,16 +129,22 @@ public:
         return true;
     }
 
-    // 获取新连接
+    // 获取新连接，新连接的套接字直接设置为非阻塞、exec时关闭，省去额外的 fcntl 调用
+    // 失败时返回 -1 并保留 errno，调用者据此区分没有新连接（EAGAIN）和描述符耗尽（EMFILE）等情况
     int Accept()
     {
-        // 调用系统函数 accept 接受一个新的连接请求
-        // int accept(int sockfd, struct sockaddr *addr, socklen_t *len);
-        int newfd = accept(_sockfd, NULL, NULL);
-        // 如果接受失败，记录错误日志并返回 -1
+        // 调用系统函数 accept4 接受一个新的连接请求
+        // int accept4(int sockfd, struct sockaddr *addr, socklen_t *len, int flags);
+        int newfd = accept4(_sockfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        // 如果接受失败，记录错误日志并返回 -1；没有新连接是非阻塞监听套接字的正常情况，描述符耗尽由调用者处理，都不记录
         if (newfd < 0)
         {
-            LOG(ERROR, "SOCKET ACCEPT FAILED!\n");
+            int err = errno;
+            if (err != EAGAIN && err != EINTR && err != EMFILE && err != ENFILE)
+            {
+                LOG(ERROR, "SOCKET ACCEPT FAILED:%s\n", strerror(err));
+            }
+            errno = err;
             return -1;
         }
         // 接受成功，返回新的套接字文件描述符
@@ -160,6 +182,34 @@ public:
         return Recv(buf, len, MSG_DONTWAIT);
     }
 
+    // 分散接收数据，一次系统调用将数据依次读入 iov 描述的多块缓冲区
+    // 返回值：大于 0 为实际接收的长度，0 表示暂时没有数据可读，-1 表示出错或对端关闭连接
+    ssize_t RecvV(struct iovec *iov, int iovcnt, int flag = MSG_DONTWAIT)
+    {
+        // 使用 recvmsg 而不是 readv，这样即使套接字是阻塞的，也能通过 MSG_DONTWAIT 实现非阻塞读取
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovcnt;
+        ssize_t ret = recvmsg(_sockfd, &msg, flag);
+        // 返回 0 表示对端已经关闭了连接
+        if (ret == 0)
+        {
+            return -1;
+        }
+        if (ret < 0)
+        {
+            // EAGAIN 表示接收缓冲区中已经没有数据了，EINTR 表示被信号打断
+            if (errno == EAGAIN || errno == EINTR)
+            {
+                return 0;
+            }
+            LOG(ERROR, "SOCKET RECVMSG FAILED!!\n");
+            return -1;
+        }
+        return ret;
+    }
+
     // 发送数据
     ssize_t Send(const void *buf, size_t len, int flag = 0)
     {
@@ -184,6 +234,116 @@ public:
         return ret;
     }
 
+    // 聚集发送数据，一次系统调用将 iov 描述的多块数据依次发送出去
+    ssize_t SendV(const struct iovec *iov, int iovcnt, int flag = MSG_DONTWAIT | MSG_NOSIGNAL)
+    {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = (struct iovec *)iov;
+        msg.msg_iovlen = iovcnt;
+        ssize_t ret = sendmsg(_sockfd, &msg, flag);
+        if (ret < 0)
+        {
+            // EAGAIN 表示发送缓冲区已满，EINTR 表示发送操作被信号打断
+            if (errno == EAGAIN || errno == EINTR)
+            {
+                return 0;
+            }
+            LOG(ERROR, "SOCKET SENDMSG FAILED!!\n");
+            return -1;
+        }
+        return ret;
+    }
+
+    // 零拷贝发送文件数据，由内核直接把文件 in_fd 从 *offset 开始的 len 字节发送到套接字，并更新 *offset
+    // 要求套接字是非阻塞的；返回值：大于 0 为实际发送的长度，0 表示发送缓冲区已满，-1 表示出错
+    ssize_t SendFile(int in_fd, off_t *offset, size_t len)
+    {
+        ssize_t ret = sendfile(_sockfd, in_fd, offset, len);
+        // 文件中已经没有数据了，说明文件在发送过程中被截断，已经无法按约定的长度发送
+        if (ret == 0 && len > 0)
+        {
+            LOG(ERROR, "SENDFILE REACHED EOF EARLY!!\n");
+            return -1;
+        }
+        if (ret < 0)
+        {
+            if (errno == EAGAIN || errno == EINTR)
+            {
+                return 0;
+            }
+            LOG(ERROR, "SOCKET SENDFILE FAILED!!\n");
+            return -1;
+        }
+        return ret;
+    }
+
+    // 以 MSG_ZEROCOPY 方式发送一段数据，内核直接引用用户空间的页面，数据在收到完成通知之前不能释放或修改
+    // *zerocopy 返回本次是否真正以零拷贝方式提交，只有零拷贝提交成功的发送才会产生一个完成通知序号
+    // 套接字的零拷贝内存额度（optmem）用尽时返回 ENOBUFS，此时退回普通发送，不算出错
+    // 返回值：大于 0 为实际发送的长度，0 表示发送缓冲区已满，-1 表示出错
+    ssize_t SendZeroCopy(const void *buf, size_t len, bool *zerocopy)
+    {
+        *zerocopy = false;
+        ssize_t ret = send(_sockfd, buf, len, MSG_DONTWAIT | MSG_NOSIGNAL | MSG_ZEROCOPY);
+        if (ret < 0 && errno == ENOBUFS)
+        {
+            ret = send(_sockfd, buf, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (ret >= 0)
+                return ret;
+        }
+        else if (ret >= 0)
+        {
+            *zerocopy = true;
+            return ret;
+        }
+        if (errno == EAGAIN || errno == EINTR)
+        {
+            return 0;
+        }
+        LOG(ERROR, "SOCKET ZEROCOPY SEND FAILED!!\n");
+        return -1;
+    }
+
+    // 从套接字的错误队列中取出一条零拷贝完成通知，通过 lo/hi 返回已经完成的发送序号区间 [lo, hi]
+    // 返回值：1 表示取到了一条通知，0 表示错误队列已空，-1 表示错误队列中是其他错误
+    int RecvZeroCopyNotify(uint32_t *lo, uint32_t *hi)
+    {
+        char control[128];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        ssize_t ret = recvmsg(_sockfd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT);
+        if (ret < 0)
+        {
+            return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+        }
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm))
+        {
+            if ((cm->cmsg_level != SOL_IP || cm->cmsg_type != IP_RECVERR) &&
+                (cm->cmsg_level != SOL_IPV6 || cm->cmsg_type != IPV6_RECVERR))
+                continue;
+            struct sock_extended_err *ee = (struct sock_extended_err *)CMSG_DATA(cm);
+            if (ee->ee_errno != 0 || ee->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+                continue;
+            *lo = ee->ee_info;
+            *hi = ee->ee_data;
+            return 1;
+        }
+        return -1;
+    }
+
+    // 获取并清除套接字上挂起的错误，没有错误返回 0
+    int GetError()
+    {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (getsockopt(_sockfd, SOL_SOCKET, SO_ERROR, (void *)&err, &len) < 0)
+            return errno;
+        return err;
+    }
+
     // 非阻塞发送数据
     ssize_t NonBlockSend(void *buf, size_t len)
     {
@@ -207,23 +367,26 @@ public:
         }
     }
 
-    // 创建一个服务端连接
-    bool CreateServer(uint16_t port, const std::string &ip = "0.0.0.0", bool block_flag = false)
+    // 创建一个服务端连接，reuse_port 为 true 时开启 SO_REUSEPORT，允许多个监听套接字绑定同一个端口
+    bool CreateServer(uint16_t port, const std::string &ip = "0.0.0.0", bool block_flag = false, bool reuse_port = false)
     {
         // 1. 创建套接字
         if (Create() == false)
             return false;
-        // 4. 如果需要，设置套接字为非阻塞模式
+        // 2. 启动地址重用，必须在绑定之前设置才有效：这样服务器重启时不会因为旧连接处于 TIME_WAIT 而绑定失败
+        ReuseAddress();
+        //    端口重用只在需要时开启，否则另一个进程也能绑定同一个端口，悄悄分走一部分连接
+        if (reuse_port)
+            ReusePort();
+        // 3. 如果需要，设置套接字为非阻塞模式
         if (block_flag)
             NonBlock();
-        // 2. 绑定地址信息
+        // 4. 绑定地址信息
         if (Bind(ip, port) == false)
             return false;
-        // 3. 开始监听连接请求
+        // 5. 开始监听连接请求
         if (Listen() == false)
             return false;
-        // 5. 启动地址端口重用
-        ReuseAddress();
         // 所有步骤都成功，返回 true
         return true;
     }
@@ -241,7 +404,7 @@ public:
         return true;
     }
 
-    // 设置套接字选项---开启地址端口重用
+    // 设置套接字选项---开启地址重用
     void ReuseAddress()
     {
         // 定义一个整数变量，用于设置选项的值
@@ -249,12 +412,35 @@ public:
         // 调用系统函数 setsockopt 开启地址重用选项
         // int setsockopt(int fd, int leve, int optname, void *val, int vallen)
         setsockopt(_sockfd, SOL_SOCKET, SO_REUSEADDR, (void *)&val, sizeof(int));
-        // 再次设置值为 1
-        val = 1;
-        // 调用系统函数 setsockopt 开启端口重用选项
+    }
+
+    // 设置套接字选项---开启端口重用，多个监听套接字绑定同一个端口，由内核在它们之间分配新连接
+    void ReusePort()
+    {
+        int val = 1;
         setsockopt(_sockfd, SOL_SOCKET, SO_REUSEPORT, (void *)&val, sizeof(int));
     }
 
+    // 设置套接字选项---TCP_NOTSENT_LOWAT，内核中未发送的数据低于该值时才报告可写，避免数据大量堆积在内核发送缓冲区中
+    void SetNotSentLowat(int bytes)
+    {
+        setsockopt(_sockfd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, (void *)&bytes, sizeof(int));
+    }
+
+    // 设置套接字选项---SO_BUSY_POLL，接收队列为空时在驱动中忙轮询 usec 微秒等待数据，而不是直接休眠等待中断
+    // 超过系统配置 net.core.busy_read 的值需要 CAP_NET_ADMIN 权限，网卡驱动不支持时不起作用，失败返回 false
+    bool SetBusyPoll(int usec)
+    {
+        return setsockopt(_sockfd, SOL_SOCKET, SO_BUSY_POLL, (void *)&usec, sizeof(int)) == 0;
+    }
+
+    // 设置套接字选项---SO_ZEROCOPY，开启之后才能使用 MSG_ZEROCOPY 发送，内核不支持时返回 false
+    bool EnableZeroCopy()
+    {
+        int val = 1;
+        return setsockopt(_sockfd, SOL_SOCKET, SO_ZEROCOPY, (void *)&val, sizeof(int)) == 0;
+    }
+
     // 设置套接字阻塞属性-- 设置为非阻塞
     void NonBlock()
     {
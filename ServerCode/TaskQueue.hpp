@@ -0,0 +1,77 @@
+#pragma once
+#include <atomic>
+#include <functional>
+
+// 无锁的多生产者单消费者任务队列，任意线程都可以投递任务，只有 EventLoop 所属线程取出任务
+// 投递只需要一次原子交换，不会因为互斥锁阻塞，也不会和取任务的 EventLoop 线程互相争抢
+// 队列总是保留一个哨兵节点：_head 指向最后投递的节点，_tail 指向已经取出的最后一个节点（即哨兵）
+class TaskQueue
+{
+public:
+    using Functor = std::function<void()>;
+
+private:
+    // 任务节点
+    struct Node
+    {
+        std::atomic<Node *> _next; // 下一个节点，生产者在投递的最后一步链接上
+        Functor _task;             // 任务函数
+
+        Node() : _next(NULL) {}
+        explicit Node(Functor &&task) : _next(NULL), _task(std::move(task)) {}
+    };
+
+    // 队列头部，生产者通过原子交换把新节点挂在这里
+    std::atomic<Node *> _head;
+    // 队列尾部的哨兵节点，只有消费者访问
+    Node *_tail;
+
+private:
+    // 把一个新节点挂到队列上
+    void PushNode(Node *node)
+    {
+        Node *prev = _head.exchange(node, std::memory_order_acq_rel);
+        // 在这一步完成之前，消费者看不到这个节点以及之后投递的节点，会在下一次取任务时看到
+        prev->_next.store(node, std::memory_order_release);
+    }
+
+public:
+    TaskQueue()
+    {
+        Node *stub = new Node();
+        _head.store(stub, std::memory_order_relaxed);
+        _tail = stub;
+    }
+
+    ~TaskQueue()
+    {
+        Functor task;
+        while (Pop(&task))
+        {
+        }
+        delete _tail;
+    }
+
+    TaskQueue(const TaskQueue &) = delete;
+    TaskQueue &operator=(const TaskQueue &) = delete;
+
+    // 投递一个任务，可以在任意线程中调用
+    void Push(const Functor &task) { PushNode(new Node(Functor(task))); }
+    void Push(Functor &&task) { PushNode(new Node(std::move(task))); }
+
+    // 取出一个任务，只能在消费者线程中调用，队列为空（或者正在投递的任务还没有链接完成）时返回 false
+    bool Pop(Functor *task)
+    {
+        Node *next = _tail->_next.load(std::memory_order_acquire);
+        if (next == NULL)
+        {
+            return false;
+        }
+        // 取出的节点成为新的哨兵，旧的哨兵释放掉
+        *task = std::move(next->_task);
+        next->_task = nullptr;
+        delete _tail;
+        _tail = next;
+        return true;
+    }
+};
@@ -2,28 +2,79 @@
 #include "LoopThreadPool.hpp"
 #include"Connection.hpp"
 #include "Acceptor.hpp"
+#include "Handoff.hpp"
+#include "ComputePool.hpp"
+#include <atomic>
+#include <unordered_map>
+
+// 停止服务器时默认等待已有连接处理完毕的时间，单位为秒，超时后强制关闭剩余的连接
+#define DEFAULT_DRAIN_TIMEOUT 30
 
 // TcpServer 类用于创建和管理一个 TCP 服务器
 class TcpServer
 {
 private:
-    // 自动增长的连接 ID，用于唯一标识每个连接
-    uint64_t _next_id; 
+    // 自动增长的连接 ID，用于唯一标识每个连接；各个从属线程的监听器会同时分配，因此是原子变量
+    std::atomic<uint64_t> _next_id; 
     // 服务器监听的端口号
     int _port; 
     // 非活跃连接的统计时间，即多长时间无通信被认为是非活跃连接
     int _timeout;                                       
     // 是否启动了非活跃连接超时销毁的判断标志
     bool _enable_inactive_release;                      
+    // 每个连接一次可读事件中最多接收的数据量
+    uint64_t _read_budget;
+    // 每个连接的输出高低水位线，高水位线为 0 表示不限制
+    uint64_t _high_water_mark;
+    uint64_t _low_water_mark;
+    // 每个连接的写停滞超时时间（秒），为 0 表示不检测
+    int _write_stall_timeout;
+    // 每个连接套接字的TCP_NOTSENT_LOWAT，为 0 表示不设置
+    int _notsent_lowat;
+    // 每个连接是否使用边缘触发模式
+    bool _edge_triggered;
+    // 每个连接的零拷贝发送阈值，为 0 表示不使用零拷贝发送
+    uint64_t _zerocopy_threshold;
+    // 处理连接的 EventLoop 的忙轮询时间（微秒），同时设置到每个连接套接字的 SO_BUSY_POLL，为 0 表示不使用
+    int _busy_poll_us;
+    // 定时器合并时间（毫秒），为 0 表示使用 EventLoop 的默认值
+    uint64_t _timer_slack;
     // 主线程的 EventLoop 对象，负责监听事件的处理
     EventLoop _baseloop;                                
-    // 监听套接字的管理对象
-    Acceptor _acceptor;                                 
+    // 是否让每个从属 EventLoop 各自监听一个开启了 SO_REUSEPORT 的套接字
+    bool _reuse_port;
+    // 监听套接字的管理对象，普通模式下只有主线程的一个，SO_REUSEPORT 模式下每个从属 EventLoop 一个
+    std::vector<std::unique_ptr<Acceptor>> _acceptors;
+    // 监听套接字交接使用的 Unix 域套接字路径，为空表示不支持交接
+    std::string _handoff_path;
+    // 交接路径上的监听描述符以及它的事件管理对象
+    int _handoff_fd;
+    std::unique_ptr<Channel> _handoff_channel;
+    // 是否已经把监听套接字交接给了新进程，交接之后交接路径归新进程所有，不能再删除
+    bool _handed_off;
+    // 交接之后排空已有连接的等待时间（秒）
+    int _drain_timeout;
+    // 服务器是否正在停止
+    bool _stopping;
+    // 计算线程池的线程数量，为 0 表示不创建
+    int _compute_threads;
+    // 计算线程池，执行耗时的业务处理
+    std::unique_ptr<ComputePool> _compute;
     // 从属 EventLoop 线程池
     LoopThreadPool _pool;                               
-    // 保存管理所有连接对应的 shared_ptr 对象，键为连接 ID，值为连接对象指针
-    std::unordered_map<uint64_t, PtrConnection> _conns; 
+    // 单个 EventLoop 的连接管理表，键为连接 ID，值为连接对象指针
+    using ConnectionMap = std::unordered_map<uint64_t, PtrConnection>;
+    // 按 EventLoop 分片保存管理所有连接对应的 shared_ptr 对象，每个分片只在所属的 EventLoop 线程中访问
+    // 连接的添加、查找和销毁都在使用它的线程中完成，关闭连接不再需要投递到主线程，连接及其缓冲区也在同一个线程中释放
+    // 分片表本身在 Start 中创建完毕后不再修改，各个线程只读取自己的分片
+    std::unordered_map<EventLoop *, ConnectionMap> _shards;
+    // ForEachConnection 和 ConnectionCount 可以在任意线程中调用，它们遍历分片表时与 Start、服务器停止时的修改互斥
+    std::mutex _shards_mutex;
+    // 服务器停止时置为 true，之后从属 EventLoop 陆续退出销毁，遍历分片表的接口不再访问它们
+    bool _shards_closed;
 
+    // 遍历连接时的回调函数类型
+    using ConnectionVisitor = std::function<void(const PtrConnection &)>;
     // 连接建立成功时的回调函数类型
     using ConnectedCallback = std::function<void(const PtrConnection &)>;
     // 接收到消息时的回调函数类型
@@ -32,6 +83,12 @@ private:
     using ClosedCallback = std::function<void(const PtrConnection &)>;
     // 发生任意事件时的回调函数类型
     using AnyEventCallback = std::function<void(const PtrConnection &)>;
+    // 异步处理完成时的回调函数类型
+    using OffloadDoneCallback = std::function<void(const PtrConnection &)>;
+    // 待发送数据超过高水位线时的回调函数类型
+    using HighWaterMarkCallback = std::function<void(const PtrConnection &, uint64_t)>;
+    // 待发送数据回落到低水位线时的回调函数类型
+    using LowWaterMarkCallback = std::function<void(const PtrConnection &)>;
     // 通用任务函数类型
     using Functor = std::function<void()>; 
 
@@ -43,24 +100,28 @@ private:
     ClosedCallback _closed_callback;
     // 发生任意事件时的回调函数
     AnyEventCallback _event_callback; 
+    // 超过高水位线时的回调函数
+    HighWaterMarkCallback _high_water_callback;
+    // 回落到低水位线时的回调函数
+    LowWaterMarkCallback _low_water_callback;
 
 private:
-    // 在主线程的 EventLoop 中添加一个定时任务
+    // 在主线程的 EventLoop 中添加一个定时任务，delay 单位为秒
     void RunAfterInLoop(const Functor &task, int delay)
     {
-        // 生成一个新的连接 ID
-        _next_id++; 
-        // 在主线程的 EventLoop 中添加一个定时任务
-        _baseloop.TimerAdd(_next_id, delay, task); 
+        _baseloop.RunAfter((uint64_t)delay * 1000, task);
     }
 
-    // 为新连接构造一个 Connection 进行管理
-    void NewConnection(int fd)
+    // 获取 EventLoop 对应的连接管理表分片，分片表在 Start 中创建完毕，这里只查找不插入，可以在各个线程中同时调用
+    ConnectionMap &Shard(EventLoop *loop) { return _shards.find(loop)->second; }
+
+    // 为新连接构造一个 Connection 进行管理，这里只进行各项设置，就绪初始化在所属的 EventLoop 中进行
+    PtrConnection NewConnection(EventLoop *loop, int fd)
     {
         // 生成一个新的连接 ID
-        _next_id++; 
-        // 创建一个新的连接对象，分配到线程池中的一个 EventLoop 上
-        PtrConnection conn(new Connection(_pool.NextLoop(), _next_id, fd)); 
+        uint64_t id = ++_next_id;
+        // 创建一个新的连接对象，分配到选定的 EventLoop 上
+        PtrConnection conn(new Connection(loop, id, fd)); 
         // 设置接收到消息时的回调函数
         conn->SetMessageCallback(_message_callback); 
         // 设置连接关闭时的回调函数
@@ -71,34 +132,214 @@ private:
         conn->SetAnyEventCallback(_event_callback); 
         // 设置服务器内部的连接关闭回调函数
         conn->SetSrvClosedCallback(std::bind(&TcpServer::RemoveConnection, this, std::placeholders::_1)); 
-        // 如果启用了非活跃连接超时销毁功能，则启动该连接的非活跃超时销毁
-        if (_enable_inactive_release)
-            conn->EnableInactiveRelease(_timeout); 
-        // 连接就绪初始化
-        conn->Established(); 
-        // 将新连接添加到连接管理表中
-        _conns.insert(std::make_pair(_next_id, conn)); 
+        // 设置一次可读事件中最多接收的数据量
+        conn->SetReadBudget(_read_budget);
+        // 设置输出高低水位线以及相关的回调和写停滞检测
+        conn->SetWaterMarks(_high_water_mark, _low_water_mark);
+        conn->SetHighWaterMarkCallback(_high_water_callback);
+        conn->SetLowWaterMarkCallback(_low_water_callback);
+        conn->SetWriteStallTimeout(_write_stall_timeout);
+        if (_notsent_lowat > 0)
+            conn->SetNotSentLowat(_notsent_lowat);
+        if (_zerocopy_threshold > 0)
+            conn->EnableZeroCopy(_zerocopy_threshold);
+        if (_edge_triggered)
+            conn->EnableEdgeTriggered();
+        if (_busy_poll_us > 0)
+            conn->SetBusyPoll(_busy_poll_us);
+        return conn;
+    }
+
+    // 处理监听器一轮接受到的所有新连接
+    // loop 为接受连接的从属 EventLoop（SO_REUSEPORT 模式），连接直接在它上面创建和处理；为空则从线程池中选择
+    void NewConnections(EventLoop *loop, const std::vector<int> &fds)
+    {
+        // 按照分配到的 EventLoop 分组，每个 EventLoop 只投递一个任务，批量完成这一组连接的就绪初始化
+        std::vector<std::pair<EventLoop *, std::vector<PtrConnection>>> groups;
+        for (auto fd : fds)
+        {
+            EventLoop *target = loop ? loop : _pool.NextLoop(fd);
+            // 立即计入所属EventLoop的连接数，同一批中后面的连接按照最新的负载分配
+            target->AddConnectionCount(1);
+            PtrConnection conn = NewConnection(target, fd);
+            size_t i = 0;
+            while (i < groups.size() && groups[i].first != target)
+                i++;
+            if (i == groups.size())
+                groups.push_back(std::make_pair(target, std::vector<PtrConnection>()));
+            groups[i].second.push_back(conn);
+        }
+        for (auto &group : groups)
+        {
+            group.first->RunInLoop(std::bind(&TcpServer::EstablishInLoop, this, group.first, std::move(group.second)));
+        }
     }
 
-    // 在主线程的 EventLoop 中移除一个连接信息
-    void RemoveConnectionInLoop(const PtrConnection &conn)
+    // 在连接所属的 EventLoop 中把一组新连接加入该 EventLoop 的连接管理表，并完成就绪初始化
+    void EstablishInLoop(EventLoop *loop, const std::vector<PtrConnection> &conns)
     {
-        // 获取连接的 ID
-        int id = conn->Id(); 
-        // 在连接管理表中查找该连接
-        auto it = _conns.find(id); 
-        // 如果找到该连接，则从管理表中移除
-        if (it != _conns.end())
+        ConnectionMap &shard = Shard(loop);
+        for (auto &conn : conns)
         {
-            _conns.erase(it);
+            // 先加入管理表，连接在就绪初始化过程中被关闭时也能正确移除
+            shard.insert(std::make_pair(conn->Id(), conn));
+            // 如果启用了非活跃连接超时销毁功能，则启动该连接的非活跃超时销毁
+            if (_enable_inactive_release)
+                conn->EnableInactiveRelease(_timeout); 
+            // 连接就绪初始化
+            conn->Established(); 
         }
     }
 
-    // 从管理 Connection 的 _conns 中移除连接信息
+    // 从连接所属 EventLoop 的管理表中移除连接信息，连接释放时在所属的 EventLoop 线程中调用
+    // 调用者持有连接的引用，移除之后连接在本次释放流程结束时在当前线程中销毁
     void RemoveConnection(const PtrConnection &conn)
     {
-        // 将移除连接信息的任务添加到主线程的 EventLoop 中执行
-        _baseloop.RunInLoop(std::bind(&TcpServer::RemoveConnectionInLoop, this, conn)); 
+        EventLoop *loop = conn->GetLoop();
+        // 连接从所属的EventLoop上移除
+        loop->AddConnectionCount(-1);
+        ConnectionMap &shard = Shard(loop);
+        // 在连接管理表中查找该连接，如果找到则从管理表中移除
+        auto it = shard.find(conn->Id());
+        if (it != shard.end())
+        {
+            shard.erase(it);
+        }
+    }
+
+    // 计算线程池处理完之后在连接所属的 EventLoop 中执行：连接还在就调用 done，然后结束连接上的这个异步处理
+    // 计算线程只持有连接的弱引用，这里在 EventLoop 线程中取得强引用，连接的最后一个引用不会在计算线程中释放
+    static void OffloadDoneInLoop(const std::weak_ptr<Connection> &weak, const OffloadDoneCallback &done)
+    {
+        PtrConnection conn = weak.lock();
+        if (!conn)
+            return;
+        done(conn);
+        conn->AddPendingWork(-1);
+    }
+
+    // 在 EventLoop 线程中遍历该 EventLoop 上的所有连接
+    void ForEachInLoop(EventLoop *loop, const ConnectionVisitor &cb)
+    {
+        // 回调中可能关闭连接，先复制一份连接列表再遍历
+        ConnectionMap &shard = Shard(loop);
+        std::vector<PtrConnection> conns;
+        conns.reserve(shard.size());
+        for (auto &it : shard)
+        {
+            conns.push_back(it.second);
+        }
+        for (auto &conn : conns)
+        {
+            cb(conn);
+        }
+    }
+
+    // 关闭交接路径上的监听描述符，没有交接出去时同时删除路径
+    void CloseHandoffServer()
+    {
+        if (_handoff_fd < 0)
+            return;
+        // 可能正处于交接描述符自己的事件回调中，Channel 对象保留到服务器销毁
+        _handoff_channel->Remove();
+        close(_handoff_fd);
+        _handoff_fd = -1;
+        if (_handed_off == false)
+            unlink(_handoff_path.c_str());
+    }
+
+    // 新进程连接到交接路径：把所有监听套接字发送给它，然后停止接受新连接，排空已有连接后退出
+    void HandleHandoff()
+    {
+        int cli = accept4(_handoff_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (cli < 0)
+            return;
+        // 只把监听套接字交给同一个用户的进程，其他进程连接上来直接关闭，服务器继续正常运行
+        if (ListenHandoff::CheckPeer(cli) == false)
+        {
+            close(cli);
+            return;
+        }
+        std::vector<int> fds;
+        for (auto &acceptor : _acceptors)
+        {
+            fds.push_back(acceptor->Fd());
+        }
+        bool ret = ListenHandoff::SendFds(cli, fds);
+        close(cli);
+        if (ret == false)
+        {
+            // 交接失败，继续正常提供服务，新进程会自己创建监听套接字
+            return;
+        }
+        LOG(INFO, "HANDED OFF %lu LISTEN SOCKETS, DRAINING CONNECTIONS\n", fds.size());
+        _handed_off = true;
+        StopInLoop(_drain_timeout);
+    }
+
+    // 在主线程中开始停止服务器：停止接受新连接，然后排空已有连接
+    void StopInLoop(int drain_sec)
+    {
+        if (_stopping)
+            return;
+        _stopping = true;
+        // 监听套接字的事件监控需要在所属的 EventLoop 线程中移除；套接字本身在服务器退出时才关闭
+        for (auto &acceptor : _acceptors)
+        {
+            acceptor->GetLoop()->RunInLoop(std::bind(&Acceptor::Stop, acceptor.get()));
+        }
+        CloseHandoffServer();
+        if (ConnectionCount() == 0 || drain_sec <= 0)
+        {
+            return DrainInLoop(0);
+        }
+        // 先留出一秒：刚建立的连接请求可能还在路上，正在处理的请求也可以自然完成，之后再关闭剩余的连接
+        RunAfterInLoop(std::bind(&TcpServer::DrainInLoop, this, drain_sec - 1), 1);
+    }
+
+    // 每秒检查一次连接是否已经排空：等待期间让还在通信的连接发送完数据后关闭，超时后强制关闭剩余的连接
+    void DrainInLoop(int remain)
+    {
+        if (ConnectionCount() == 0 || remain < 0)
+        {
+            if (remain < 0)
+                LOG(WARNING, "%lu CONNECTIONS NOT RELEASED AFTER DRAIN TIMEOUT\n", ConnectionCount());
+            return FinishStopInLoop();
+        }
+        if (remain > 0)
+        {
+            // 已经关闭的连接不再重复处理；每一轮都检查一次，停止前已经接受、还在路上的连接也会被关闭
+            ForEachConnection([](const PtrConnection &conn)
+                              { if (conn->Connected()) conn->Shutdown(); });
+        }
+        else
+        {
+            ForEachConnection([](const PtrConnection &conn)
+                              { conn->Release(); });
+        }
+        RunAfterInLoop(std::bind(&TcpServer::DrainInLoop, this, remain - 1), 1);
+    }
+
+    // 连接已经排空，停止所有从属线程，关闭监听套接字，最后让主线程的 EventLoop 退出，Start 随之返回
+    void FinishStopInLoop()
+    {
+        // 先停止计算线程池，已经提交的任务执行完，结果投递到还在运行的 EventLoop 中
+        if (_compute)
+            _compute->Stop();
+        // 先标记分片表已关闭，其他线程不再通过它访问即将退出的 EventLoop；
+        // 停止线程池时不持有锁，从属线程中的回调可能还会调用 ConnectionCount
+        {
+            std::unique_lock<std::mutex> lock(_shards_mutex);
+            _shards_closed = true;
+        }
+        _pool.Stop();
+        {
+            std::unique_lock<std::mutex> lock(_shards_mutex);
+            _shards.clear();
+        }
+        _acceptors.clear();
+        LOG(INFO, "SERVER STOPPED\n");
+        _baseloop.Quit();
     }
 
 public:
@@ -106,17 +347,54 @@ public:
     TcpServer(int port) : _port(port),
                           _next_id(0),
                           _enable_inactive_release(false),
-                          _acceptor(&_baseloop, port),
-                          _pool(&_baseloop)
+                          _read_budget(DEFAULT_READ_BUDGET),
+                          _high_water_mark(0),
+                          _low_water_mark(0),
+                          _write_stall_timeout(0),
+                          _notsent_lowat(0),
+                          _edge_triggered(false),
+                          _zerocopy_threshold(0),
+                          _busy_poll_us(0), _timer_slack(0),
+                          _reuse_port(false),
+                          _handoff_fd(-1),
+                          _handed_off(false),
+                          _drain_timeout(DEFAULT_DRAIN_TIMEOUT),
+                          _stopping(false),
+                          _compute_threads(0),
+                          _pool(&_baseloop),
+                          _shards_closed(false)
     {
-        // 设置接受器的回调函数，当有新连接时调用 NewConnection 函数
-        _acceptor.SetAcceptCallback(std::bind(&TcpServer::NewConnection, this, std::placeholders::_1));
-        // 启动监听套接字的读事件监控
-        _acceptor.Listen(); 
     }
 
     // 设置线程池中的线程数量
     void SetThreadCount(int count) { return _pool.SetThreadCount(count); }
+    // 设置主线程和从属线程绑定的 CPU，需要在 Start 之前设置
+    // cpus 为空表示使用进程允许运行的所有 CPU，reserved 中的 CPU 保留给中断处理等其他用途
+    void SetCpuAffinity(const std::vector<int> &cpus, const std::vector<int> &reserved = std::vector<int>())
+    {
+        return _pool.SetCpuAffinity(cpus, reserved);
+    }
+    // 开启忙轮询模式，处理连接的 EventLoop 在阻塞等待事件之前先忙轮询 usec 微秒，需要在 Start 之前设置
+    // 以占用更多 CPU 为代价降低空闲到繁忙时的唤醒延迟，连接套接字同时尽量开启 SO_BUSY_POLL
+    void SetBusyPoll(int usec) { _busy_poll_us = usec; }
+    // 设置所有 EventLoop 的定时器合并时间（毫秒），定时器最多推迟这么久执行，相近的到期时间合并为一次唤醒，需要在 Start 之前设置
+    void SetTimerSlack(uint64_t ms) { _timer_slack = ms; }
+    // 获取处理连接的各个 EventLoop 的忙轮询统计，需要在 Start 之后调用
+    void GetLoopStats(std::vector<LoopStats> *stats)
+    {
+        const std::vector<EventLoop *> &loops = _pool.GetLoops();
+        std::vector<EventLoop *> owners = loops.empty() ? std::vector<EventLoop *>(1, &_baseloop) : loops;
+        stats->resize(owners.size());
+        for (size_t i = 0; i < owners.size(); i++)
+        {
+            owners[i]->GetStats(&(*stats)[i]);
+        }
+    }
+    // 设置新连接分配到从属线程 EventLoop 的策略，SO_REUSEPORT 模式下由内核分配，不使用该策略
+    void SetLoadBalance(LoadBalance balance) { return _pool.SetLoadBalance(balance); }
+    // 设置从属线程 EventLoop 事件监控使用的后端（epoll 或 io_uring），需要在 Start 之前设置
+    // 主线程的 EventLoop 只负责监听套接字，仍然使用 epoll；需要由 io_uring 多次触发 accept 接受新连接时同时开启 EnableReusePort
+    void SetPollerBackend(PollerBackend backend) { return _pool.SetPollerBackend(backend); }
     // 设置连接建立成功时的回调函数
     void SetConnectedCallback(const ConnectedCallback &cb) { _connected_callback = cb; }
     // 设置接收到消息时的回调函数
@@ -133,18 +411,200 @@ public:
         _enable_inactive_release = true;
     }
 
-    // 用于添加一个定时任务
-    void RunAfter(const Functor &task, int delay)
+    // 设置每个连接一次可读事件中最多接收的数据量，读满后剩余数据留给下一轮事件循环
+    void SetReadBudget(uint64_t budget) { _read_budget = budget; }
+
+    // 设置每个连接的输出高低水位线：待发送数据超过high时暂停读，回落到low以下时恢复读，high为0表示不限制
+    void SetWaterMarks(uint64_t high, uint64_t low)
+    {
+        _high_water_mark = high;
+        _low_water_mark = low;
+    }
+    // 设置超过高水位线时的回调函数
+    void SetHighWaterMarkCallback(const HighWaterMarkCallback &cb) { _high_water_callback = cb; }
+    // 设置回落到低水位线时的回调函数
+    void SetLowWaterMarkCallback(const LowWaterMarkCallback &cb) { _low_water_callback = cb; }
+    // 设置写停滞超时时间（秒），暂停读之后超过这个时间没有发出任何数据就释放连接
+    void SetWriteStallTimeout(int sec) { _write_stall_timeout = sec; }
+    // 设置每个连接套接字的TCP_NOTSENT_LOWAT（字节）
+    void SetNotSentLowat(int bytes) { _notsent_lowat = bytes; }
+    // 开启 SO_REUSEPORT 监听模式，需要在 Start 之前设置：每个从属 EventLoop 各自监听一个绑定同一端口的套接字，
+    // 由内核把新连接分散到各个套接字上，连接的接受、创建和事件处理都在同一个线程中完成，主线程不再是建连的瓶颈
+    // 线程池中没有从属线程时不起作用
+    void EnableReusePort() { _reuse_port = true; }
+    // 开启边缘触发模式，之后建立的连接读写都进行到EAGAIN为止，写事件一直保持监控
+    void EnableEdgeTriggered() { _edge_triggered = true; }
+    // 开启零拷贝发送，不小于threshold字节的数据块使用MSG_ZEROCOPY发送，适合大的动态响应
+    void EnableZeroCopy(uint64_t threshold = DEFAULT_ZEROCOPY_THRESHOLD) { _zerocopy_threshold = threshold; }
+
+    // 用于添加一个定时任务，delay 单位为秒，在主线程的 EventLoop 中执行，返回的句柄可以交给 Cancel 取消
+    TimerId RunAfter(const Functor &task, int delay)
+    {
+        return _baseloop.RunAfter((uint64_t)delay * 1000, task);
+    }
+
+    // 添加一个每隔 interval 秒执行一次的定时任务，在主线程的 EventLoop 中执行，返回的句柄可以交给 Cancel 取消
+    TimerId RunEvery(const Functor &task, int interval)
+    {
+        return _baseloop.RunEvery((uint64_t)interval * 1000, task);
+    }
+
+    // 取消 RunAfter/RunEvery 添加的定时任务，可以在任意线程中调用
+    void Cancel(TimerId id) { _baseloop.Cancel(id); }
+
+    // 遍历服务器上的所有连接，可以在任意线程中调用
+    // 每个 EventLoop 的连接在该 EventLoop 线程中异步遍历，回调函数会在多个线程中被同时调用
+    void ForEachConnection(const ConnectionVisitor &cb)
+    {
+        std::unique_lock<std::mutex> lock(_shards_mutex);
+        if (_shards_closed)
+            return;
+        for (auto &it : _shards)
+        {
+            it.first->RunInLoop(std::bind(&TcpServer::ForEachInLoop, this, it.first, cb));
+        }
+    }
+
+    // 开启监听套接字交接，需要在 Start 之前设置
+    // Start 时先连接 path，如果有旧进程在运行，就接管它的监听套接字，旧进程随后排空连接并退出；否则自己创建监听套接字
+    // 之后在 path 上等待下一个新进程来接管，交接完成后停止接受新连接，最多等待 drain_sec 秒排空已有连接后退出
+    void EnableHandoff(const std::string &path, int drain_sec = DEFAULT_DRAIN_TIMEOUT)
+    {
+        _handoff_path = path;
+        _drain_timeout = drain_sec;
+    }
+
+    // 停止服务器，可以在任意线程中调用：立即停止接受新连接，已有连接发送完数据后关闭，
+    // 最多等待 drain_sec 秒，超时后强制关闭剩余的连接；所有线程退出后 Start 返回
+    void Stop(int drain_sec = DEFAULT_DRAIN_TIMEOUT)
     {
-        // 将添加定时任务的操作添加到主线程的 EventLoop 中执行
-        _baseloop.RunInLoop(std::bind(&TcpServer::RunAfterInLoop, this, task, delay)); 
+        _baseloop.RunInLoop(std::bind(&TcpServer::StopInLoop, this, drain_sec));
     }
 
-    // 启动服务器
+    // 设置计算线程池的线程数量，需要在 Start 之前设置，为 0 表示不创建计算线程池
+    void SetComputeThreads(int count) { _compute_threads = count; }
+
+    // 把耗时的业务处理 work 交给计算线程池执行，执行完之后在连接所属的 EventLoop 中执行 done(conn)（例如发送结果）
+    // EventLoop 线程不会被耗时的处理阻塞，同一个线程上的其他连接和定时器不受影响；没有计算线程池时在当前线程中执行 work
+    // 需要在连接所属的 EventLoop 线程中调用（例如消息回调中）；work 和 done 都不应该持有连接的引用
+    // 处理期间对端半关闭或者调用 Shutdown 不会释放连接，done 发送的结果仍然能发出去；
+    // 连接因为出错、超时等被强制释放并销毁时不再调用 done，释放了但还没有销毁时 done 中需要用 Disconnected 判断
+    void Offload(const PtrConnection &conn, const Functor &work, const OffloadDoneCallback &done)
+    {
+        EventLoop *loop = conn->GetLoop();
+        conn->AddPendingWork(1);
+        std::weak_ptr<Connection> weak(conn);
+        if (!_compute)
+        {
+            work();
+            // done 放到任务池中执行，与使用计算线程池时的调用时机一致
+            return loop->QueueInLoop(std::bind(&TcpServer::OffloadDoneInLoop, weak, done));
+        }
+        _compute->Submit([weak, loop, work, done]()
+                         {
+                             work();
+                             loop->QueueInLoop(std::bind(&TcpServer::OffloadDoneInLoop, weak, done));
+                         });
+    }
+
+    // 获取服务器当前的连接数量，可以在任意线程中调用，结果是近似值
+    uint64_t ConnectionCount()
+    {
+        int64_t count = 0;
+        std::unique_lock<std::mutex> lock(_shards_mutex);
+        if (_shards_closed)
+            return 0;
+        for (auto &it : _shards)
+        {
+            count += it.first->ConnectionCount();
+        }
+        return count > 0 ? count : 0;
+    }
+
+    // 启动服务器，调用 Stop 或者监听套接字交接给新进程之后返回
     void Start()
     {
-        // 创建线程池中的线程
+        // 创建线程池中的线程，设置了 CPU 绑定时主线程也在这里绑定
         _pool.Create(); 
+        // 创建计算线程池
+        if (_compute_threads > 0)
+            _compute.reset(new ComputePool(_compute_threads));
+        const std::vector<EventLoop *> &loops = _pool.GetLoops();
+        // 为每个会拥有连接的 EventLoop 创建连接管理表分片，没有从属线程时连接由主线程处理
+        {
+            std::unique_lock<std::mutex> lock(_shards_mutex);
+            if (loops.empty())
+            {
+                _shards[&_baseloop];
+            }
+            for (auto loop : loops)
+            {
+                _shards[loop];
+            }
+        }
+        // 处理连接的 EventLoop 开启忙轮询，只负责监听的主线程仍然阻塞等待
+        if (_busy_poll_us > 0)
+        {
+            for (auto &it : _shards)
+            {
+                it.first->SetBusyPoll(_busy_poll_us);
+            }
+        }
+        // 定时器合并时间对主线程也生效，主线程上有 RunAfter 添加的定时任务
+        if (_timer_slack > 0)
+        {
+            _baseloop.SetTimerSlack(_timer_slack);
+            for (auto loop : loops)
+            {
+                loop->SetTimerSlack(_timer_slack);
+            }
+        }
+        // 接管旧进程的监听套接字，没有旧进程时 inherited 为空，下面全部新建
+        std::vector<int> inherited;
+        if (_handoff_path.empty() == false && ListenHandoff::Receive(_handoff_path, &inherited))
+        {
+            LOG(INFO, "TAKE OVER %lu LISTEN SOCKETS FROM OLD PROCESS\n", inherited.size());
+        }
+        size_t next = 0;
+        // 创建监听套接字
+        if (_reuse_port && loops.empty() == false)
+        {
+            for (auto loop : loops)
+            {
+                Acceptor *acceptor = new Acceptor(loop, _port, next < inherited.size() ? inherited[next++] : -1, true);
+                _acceptors.push_back(std::unique_ptr<Acceptor>(acceptor));
+                // 接受到的连接直接交给接受它的 EventLoop
+                acceptor->SetAcceptCallback(std::bind(&TcpServer::NewConnections, this, loop, std::placeholders::_1));
+                // 读事件监控需要在所属的 EventLoop 线程中启动
+                loop->RunInLoop(std::bind(&Acceptor::Listen, acceptor));
+            }
+        }
+        else
+        {
+            Acceptor *acceptor = new Acceptor(&_baseloop, _port, next < inherited.size() ? inherited[next++] : -1);
+            _acceptors.push_back(std::unique_ptr<Acceptor>(acceptor));
+            // 设置接受器的回调函数，当有新连接时调用 NewConnection 函数
+            acceptor->SetAcceptCallback(std::bind(&TcpServer::NewConnections, this, (EventLoop *)NULL, std::placeholders::_1));
+            // 启动监听套接字的读事件监控
+            acceptor->Listen();
+        }
+        // 旧进程的监听套接字比本进程需要的多（例如 SO_REUSEPORT 模式下线程数量减少），多出来的关闭，其中排队的连接会被重置
+        for (; next < inherited.size(); next++)
+        {
+            LOG(WARNING, "CLOSE EXTRA INHERITED LISTEN SOCKET %d\n", inherited[next]);
+            close(inherited[next]);
+        }
+        // 等待下一个新进程来接管
+        if (_handoff_path.empty() == false)
+        {
+            _handoff_fd = ListenHandoff::CreateServer(_handoff_path);
+            if (_handoff_fd >= 0)
+            {
+                _handoff_channel.reset(new Channel(&_baseloop, _handoff_fd));
+                _handoff_channel->SetReadCallback(std::bind(&TcpServer::HandleHandoff, this));
+                _handoff_channel->EnableRead();
+            }
+        }
         // 启动主线程的 EventLoop
         _baseloop.Start(); 
     }
@@ -2,198 +2,446 @@
 #include "../Log.hpp"
 #include "Channel.hpp"
 #include <sys/timerfd.h>
+#include <time.h>
+#include <stdint.h>
 #include <vector>
 #include <memory>
+#include <atomic>
 #include <unordered_map>
 
+// 默认的定时器合并时间，单位为毫秒；定时器最多推迟这么久执行，落在同一个区间内的到期时间合并为一次唤醒
+#define TIMER_DEFAULT_SLACK_MS 1
+// 第一层时间轮的槽位数（2^8），覆盖 256 毫秒
+#define TIMER_NEAR_BITS 8
+#define TIMER_NEAR_SIZE (1 << TIMER_NEAR_BITS)
+// 上层时间轮每层的槽位数（2^6），每层覆盖的时间是下一层的 64 倍
+#define TIMER_LEVEL_BITS 6
+#define TIMER_LEVEL_SIZE (1 << TIMER_LEVEL_BITS)
+// 上层时间轮的层数，四层之后总共覆盖 2^32 毫秒（约 49 天）
+#define TIMER_LEVELS 4
+
 using namespace log_ns;
 
 // 定义任务函数类型，是一个无返回值、无参数的函数对象
 using TaskFunc = std::function<void()>;
-// 定义释放函数类型，是一个无返回值、无参数的函数对象
-using ReleaseFunc = std::function<void()>;
 
-// 定时器任务类，代表一个具体的定时任务
-class TimerTask
+class TimerWheel;
+
+// RunAfter/RunEvery 返回的定时器句柄，用于 Cancel；句柄只是所属时间轮和一个序号，定时器执行完或者取消之后再使用也是安全的
+// 序号只在所属的时间轮中唯一，把句柄交给其他 EventLoop 取消时会被忽略，不会误取消那边序号相同的定时器
+class TimerId
 {
+    friend class TimerWheel;
+
 private:
-    uint64_t _id;         // 定时器任务对象的唯一标识符
-    uint32_t _timeout;    // 定时任务的超时时间，单位为秒
-    bool _canceled;       // 标记定时任务是否被取消，false 表示未取消，true 表示已取消
-    TaskFunc _task_cb;    // 定时器任务要执行的回调函数
-    ReleaseFunc _release; // 用于删除 TimerWheel 中保存的定时器对象信息的回调函数
+    TimerWheel *_wheel; // 创建定时器的时间轮
+    uint64_t _seq;      // 定时器的序号，同一个 EventLoop 中不会重复，0 表示无效句柄
+
+    TimerId(TimerWheel *wheel, uint64_t seq) : _wheel(wheel), _seq(seq) {}
 
 public:
-    // 构造函数，初始化定时器任务的相关信息
-    TimerTask(uint64_t id, uint32_t delay, const TaskFunc &cb) 
-        : _id(id), _timeout(delay), _task_cb(cb), _canceled(false) {}
+    TimerId() : _wheel(NULL), _seq(0) {}
 
-    // 析构函数，如果任务未被取消，则执行任务回调函数，并调用释放函数
-    ~TimerTask()
+    // 是否是一个有效的句柄
+    bool Valid() const { return _seq != 0; }
+};
+
+// 定时器节点，直接嵌入在使用者的对象中（例如 Connection），时间轮的槽位把节点串成链表，添加、删除都不需要分配内存
+// 节点的操作只能在所属 EventLoop 的线程中进行；节点析构时会自动从时间轮中摘除
+class TimerNode
+{
+    friend class TimerWheel;
+
+private:
+    TimerNode *_next;   // 同一个槽位中的下一个节点
+    TimerNode **_pprev; // 指向前一个节点的 _next（或者槽位的链表头），不在时间轮中时为 NULL
+    uint64_t _expire;   // 放入槽位时计算的到期时间，单调时钟的毫秒数
+    uint64_t _timeout;  // 超时时间，单位为毫秒
+    uint64_t _active;   // 最近一次活跃的时间，到期时如果活跃之后还没有经过超时时间，就重新放置而不执行
+    TaskFunc _task_cb;  // 到期时执行的回调函数
+
+private:
+    // 从所在的槽位链表中摘除
+    void Unlink()
     {
-        if (_canceled == false)
-            _task_cb();
-        _release();
+        if (_pprev == NULL)
+            return;
+        *_pprev = _next;
+        if (_next)
+            _next->_pprev = _pprev;
+        _next = NULL;
+        _pprev = NULL;
     }
 
-    // 取消定时器任务，将 _canceled 标记为 true
-    void Cancel() { _canceled = true; }
+    // 插入到槽位链表的头部
+    void Link(TimerNode **head)
+    {
+        _next = *head;
+        if (_next)
+            _next->_pprev = &_next;
+        *head = this;
+        _pprev = head;
+    }
 
-    // 设置释放函数
-    void SetRelease(const ReleaseFunc &cb) { _release = cb; }
+public:
+    TimerNode() : _next(NULL), _pprev(NULL), _expire(0), _timeout(0), _active(0) {}
+    explicit TimerNode(const TaskFunc &cb) : _next(NULL), _pprev(NULL), _expire(0), _timeout(0), _active(0), _task_cb(cb) {}
+    ~TimerNode() { Unlink(); }
+
+    TimerNode(const TimerNode &) = delete;
+    TimerNode &operator=(const TimerNode &) = delete;
+
+    // 设置到期时执行的回调函数
+    void SetCallback(const TaskFunc &cb) { _task_cb = cb; }
 
-    // 获取定时任务的超时时间
-    uint32_t DelayTime() { return _timeout; }
+    // 是否在时间轮中等待到期
+    bool Pending() { return _pprev != NULL; }
+
+    // 记录一次活跃，到期时间顺延到 now 之后的一个超时时间；只有一次赋值，适合在每个事件中调用
+    void Touch(uint64_t now) { _active = now; }
 };
 
 // 定时器轮类，实现定时器的管理和调度
+// 采用多层时间轮：第一层 256 个槽位，每个槽位 1 毫秒；之上四层各 64 个槽位，每个槽位是下一层一整圈的时间
+// 节点按照距离到期的时间放入对应的层，上层的槽位轮到时把其中的节点重新分散到下层，最终在第一层到期执行
+// 这样同一个循环中既可以有几十毫秒的超时，也可以有几个小时的超时，添加、删除都只是链表操作
+// 刷新采用惰性的方式：节点只记录最近活跃的时间，到期时发现期间有过活跃就按活跃时间重新放置，频繁活跃的连接不会反复移动节点
 class TimerWheel
 {
 private:
-    // 定义弱指针类型，用于存储定时器任务的弱引用
-    using WeakTask = std::weak_ptr<TimerTask>;
-    // 定义共享指针类型，用于存储定时器任务的共享引用
-    using PtrTask = std::shared_ptr<TimerTask>;
-
-    int _tick;     // 当前的时间刻度，类似于时钟的秒针，走到哪里就释放哪里的任务
-    int _capacity; // 定时器轮的容量，即最大延迟时间，单位为秒
-    // 定时器轮，二维向量，每个元素是一个存储定时器任务共享指针的向量
-    std::vector<std::vector<PtrTask>> _wheel;
-    // 存储定时器任务的映射，键为任务 ID，值为定时器任务的弱指针
-    std::unordered_map<uint64_t, WeakTask> _timers;
+    uint64_t _current; // 时间轮当前走到的时间，单调时钟的毫秒数，小于这个时间到期的节点都已经处理
+    // 第一层时间轮，每个槽位对应 1 毫秒，槽位是节点链表的头指针
+    std::vector<TimerNode *> _near;
+    // 上层时间轮，_levels[i] 的每个槽位对应 2^(8+6*i) 毫秒
+    std::vector<std::vector<TimerNode *>> _levels;
+
+    // RunAfter/RunEvery 添加的定时器，由时间轮分配和释放
+    struct LoopTimer
+    {
+        TimerNode _node;    // 定时器节点
+        uint64_t _interval; // 周期，单位为毫秒，0 表示只执行一次
+        bool _running;      // 回调函数是否正在执行
+        bool _canceled;     // 是否在回调函数执行期间被取消
+        TaskFunc _task_cb;  // 使用者的回调函数
+    };
+    // 定时器序号到定时器的映射，句柄只保存序号，取消时在这里查找
+    std::unordered_map<uint64_t, std::unique_ptr<LoopTimer>> _loop_timers;
+    // 下一个定时器序号，可以在任意线程中分配
+    std::atomic<uint64_t> _next_seq;
+
+    // 定时器合并时间（毫秒），timerfd 只设置到它的整数倍上
+    uint64_t _slack;
+    // timerfd 当前设置的触发时间，单调时钟的毫秒数，UINT64_MAX 表示没有设置
+    uint64_t _armed;
+    // 是否正在推进时间轮，推进期间放置节点不设置 timerfd，推进结束之后统一设置
+    bool _advancing;
 
     EventLoop *_loop; // 事件循环指针，用于将定时器任务的操作放入事件循环中执行
+    // EventLoop 的时钟，每轮事件循环更新一次，定时器的时间都从这里读取
+    CachedClock *_clock;
     int _timerfd;     // 定时器文件描述符，用于触发定时器事件
     // 定时器通道，用于处理定时器文件描述符的事件
     std::unique_ptr<Channel> _timer_channel;
 
 private:
-    // 从 _timers 映射中移除指定 ID 的定时器任务
-    void RemoveTimer(uint64_t id)
-    {
-        auto it = _timers.find(id);
-        if (it != _timers.end())
-        {
-            _timers.erase(it);
-        }
-    }
-
-    // 创建定时器文件描述符，并设置定时器的超时时间和间隔时间
+    // 创建定时器文件描述符，创建时不设置触发时间，有定时器之后才按最近的到期时间设置
     static int CreateTimerfd()
     {
-        // 创建一个单调时钟的定时器文件描述符
-        int timerfd = timerfd_create(CLOCK_MONOTONIC, 0);
+        // 创建一个单调时钟的定时器文件描述符；非阻塞，重新设置触发时间会清除已经触发但还没有读取的计数
+        int timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
         if (timerfd < 0)
         {
             // 记录错误日志并终止程序
             LOG(ERROR, "TIMERFD CREATE FAILED!\n");
             abort();
         }
-
-        // 定义定时器的超时时间和间隔时间
-        struct itimerspec itime;
-        itime.it_value.tv_sec = 1;    // 第一次超时时间为 1 秒后
-        itime.it_value.tv_nsec = 0;
-        itime.it_interval.tv_sec = 1; // 第一次超时后，每次超时的间隔为 1 秒
-        itime.it_interval.tv_nsec = 0;
-
-        // 设置定时器的超时时间和间隔时间
-        timerfd_settime(timerfd, 0, &itime, NULL);
         return timerfd;
     }
 
-    // 读取定时器文件描述符，获取从上一次读取之后超时的次数
-    int ReadTimefd()
+    // 读取定时器文件描述符，清除可读事件
+    void ReadTimefd()
     {
         uint64_t times;
-        // 有可能因为其他描述符的事件处理花费事件比较长，然后在处理定时器描述符事件的时候，有可能就已经超时了很多次
-        // 读取定时器文件描述符，获取超时次数
         int ret = read(_timerfd, &times, 8);
-        if (ret < 0)
+        if (ret < 0 && errno != EAGAIN && errno != EINTR)
         {
             // 记录错误日志并终止程序
             LOG(ERROR, "READ TIMEFD FAILED!\n");
             abort();
         }
-        return times;
     }
 
-    // 每秒钟调用一次，模拟时钟的秒针向前走一步
+    // 把 timerfd 设置为在 when 毫秒（单调时钟的绝对时间）触发一次，when 为 UINT64_MAX 时取消设置
+    void Arm(uint64_t when)
+    {
+        struct itimerspec itime;
+        memset(&itime, 0, sizeof(itime));
+        if (when != UINT64_MAX)
+        {
+            itime.it_value.tv_sec = when / 1000;
+            itime.it_value.tv_nsec = (when % 1000) * 1000000;
+        }
+        if (timerfd_settime(_timerfd, TFD_TIMER_ABSTIME, &itime, NULL) < 0)
+        {
+            LOG(ERROR, "TIMERFD SETTIME FAILED:%s\n", strerror(errno));
+            abort();
+        }
+        _armed = when;
+    }
+
+    // 把到期时间向上取整到合并时间的整数倍，多个相近的到期时间因此落在同一个触发时间上
+    uint64_t Coalesce(uint64_t expire) { return (expire + _slack - 1) / _slack * _slack; }
+
+    // 获取最早需要处理的时间：第一层中最近的非空槽位，或者上层中最近一个非空槽位的下放时间；没有节点时返回 UINT64_MAX
+    // 上层槽位中节点的真实到期时间不晚于下放时间，在下放时间唤醒一次，之后再按真实的到期时间设置
+    uint64_t NextExpire()
+    {
+        uint64_t next = UINT64_MAX;
+        for (int k = 0; k < TIMER_NEAR_SIZE; k++)
+        {
+            if (_near[(_current + k) & (TIMER_NEAR_SIZE - 1)])
+            {
+                next = _current + k;
+                break;
+            }
+        }
+        for (int i = 0; i < TIMER_LEVELS; i++)
+        {
+            int shift = TIMER_NEAR_BITS + i * TIMER_LEVEL_BITS;
+            // 从不早于当前时间的第一个下放时间开始，_current 恰好在下放时间上时这次下放还没有进行
+            uint64_t first = (_current + (1ULL << shift) - 1) >> shift;
+            for (int k = 0; k < TIMER_LEVEL_SIZE; k++)
+            {
+                uint64_t when = (first + k) << shift;
+                if (when >= next)
+                    break;
+                if (_levels[i][(first + k) & (TIMER_LEVEL_SIZE - 1)])
+                {
+                    next = when;
+                    break;
+                }
+            }
+        }
+        return next;
+    }
+
+    // 按照最早需要处理的时间重新设置 timerfd，没有定时器时取消设置，空闲的 EventLoop 不会被定时器唤醒
+    void Rearm()
+    {
+        uint64_t next = NextExpire();
+        uint64_t when = next == UINT64_MAX ? UINT64_MAX : Coalesce(next);
+        if (when != _armed)
+            Arm(when);
+    }
+
+    // 根据节点的到期时间把它放入对应层的槽位
+    void Place(TimerNode *node)
+    {
+        uint64_t expire = node->_expire;
+        // 已经到期的节点放入当前槽位，下一次走动时执行
+        if (expire < _current)
+            expire = _current;
+        // 比 timerfd 当前的触发时间更早到期时，提前触发时间；推进时间轮期间由推进结束时统一设置
+        if (_advancing == false)
+        {
+            uint64_t when = Coalesce(expire);
+            if (when < _armed)
+                Arm(when);
+        }
+        uint64_t diff = expire - _current;
+        if (diff < TIMER_NEAR_SIZE)
+        {
+            node->Link(&_near[expire & (TIMER_NEAR_SIZE - 1)]);
+            return;
+        }
+        for (int i = 0; i < TIMER_LEVELS; i++)
+        {
+            int shift = TIMER_NEAR_BITS + i * TIMER_LEVEL_BITS;
+            if (diff < (1ULL << (shift + TIMER_LEVEL_BITS)) || i == TIMER_LEVELS - 1)
+            {
+                // 超出最上层范围的节点先放在最上层最远的槽位，轮到时按真实的到期时间重新放置，因此超时时间没有上限
+                if (diff >= (1ULL << (shift + TIMER_LEVEL_BITS)))
+                    expire = _current + (1ULL << (shift + TIMER_LEVEL_BITS)) - 1;
+                node->Link(&_levels[i][(expire >> shift) & (TIMER_LEVEL_SIZE - 1)]);
+                return;
+            }
+        }
+    }
+
+    // 把上层时间轮一个槽位中的节点重新放置到下层，返回槽位的索引
+    int Cascade(int level)
+    {
+        int idx = (_current >> (TIMER_NEAR_BITS + level * TIMER_LEVEL_BITS)) & (TIMER_LEVEL_SIZE - 1);
+        TimerNode *&slot = _levels[level][idx];
+        while (slot)
+        {
+            TimerNode *node = slot;
+            node->Unlink();
+            Place(node);
+        }
+        return idx;
+    }
+
+    // 处理一个到期的节点：期间有过活跃就顺延，否则执行回调函数
+    void Expire(TimerNode *node)
+    {
+        if (node->_active + node->_timeout > node->_expire)
+        {
+            node->_expire = node->_active + node->_timeout;
+            Place(node);
+            return;
+        }
+        // 回调函数中可能会重新设置或者释放这个节点，先复制一份再执行
+        TaskFunc cb = node->_task_cb;
+        cb();
+    }
+
+    // 时间轮走动一毫秒，处理当前槽位中的节点
     void RunTimerTask()
     {
-        // 更新时间刻度，取模操作确保刻度在容量范围内循环
-        _tick = (_tick + 1) % _capacity;
-        // 清空当前刻度对应的定时器任务向量，释放其中的共享指针
-        _wheel[_tick].clear(); 
+        int idx = _current & (TIMER_NEAR_SIZE - 1);
+        // 第一层走完一圈，从上层取出下一段时间的节点；某一层也走完一圈时，继续从更上一层取
+        if (idx == 0)
+        {
+            for (int i = 0; i < TIMER_LEVELS; i++)
+            {
+                if (Cascade(i) != 0)
+                    break;
+            }
+        }
+        // 先把当前槽位的链表整个取下来并推进时间，回调函数中新添加的节点不会放回正在处理的槽位
+        // 取下的链表头是局部变量，回调函数中停止链表中的其他节点时仍然可以正常摘除
+        TimerNode *expired = NULL;
+        if (_near[idx])
+        {
+            expired = _near[idx];
+            _near[idx] = NULL;
+            expired->_pprev = &expired;
+        }
+        _current++;
+        while (expired)
+        {
+            TimerNode *node = expired;
+            node->Unlink();
+            Expire(node);
+        }
     }
 
-    // 处理定时器超时事件，根据实际超时次数执行相应的任务
-    void OnTime()
+    // 把时间轮推进到 now，处理期间到期的节点，然后按照下一个到期时间重新设置 timerfd
+    void Advance(uint64_t now)
     {
-        // 读取定时器文件描述符，获取超时次数
-        int times = ReadTimefd();
-        // 根据超时次数，多次调用 RunTimerTask 函数
-        for (int i = 0; i < times; i++)
+        _advancing = true;
+        while (_current <= now)
         {
+            // 中间没有需要处理的槽位时直接跳过，长时间空闲之后不需要一毫秒一毫秒地走
+            uint64_t next = NextExpire();
+            if (next > now)
+            {
+                _current = now + 1;
+                break;
+            }
+            if (next > _current)
+                _current = next;
             RunTimerTask();
         }
+        _advancing = false;
+        Rearm();
     }
 
-    // 在事件循环的线程中添加一个定时器任务
-    void TimerAddInLoop(uint64_t id, uint32_t delay, const TaskFunc &cb)
+    // 处理定时器超时事件，按照实际经过的时间推进时间轮
+    void OnTime()
+    {
+        // 读取定时器文件描述符，清除可读事件
+        ReadTimefd();
+        Advance(_clock->MonotonicMs());
+    }
+
+    // 在事件循环的线程中设置定时器合并时间
+    void SetSlackInLoop(uint64_t slack)
+    {
+        _slack = slack > 0 ? slack : 1;
+        if (_armed != UINT64_MAX)
+            Rearm();
+    }
+
+    // 在事件循环的线程中添加一个 RunAfter/RunEvery 定时器
+    void RunAddInLoop(uint64_t seq, uint64_t delay, uint64_t interval, const TaskFunc &cb)
+    {
+        LoopTimer *timer = new LoopTimer();
+        timer->_interval = interval;
+        timer->_running = false;
+        timer->_canceled = false;
+        timer->_task_cb = cb;
+        // 只捕获两个整数大小的值，std::function 不需要额外分配内存
+        timer->_node.SetCallback([this, seq]()
+                                 { OnLoopTimer(seq); });
+        _loop_timers[seq].reset(timer);
+        TimerStart(&timer->_node, delay);
+    }
+
+    // 在事件循环的线程中取消一个 RunAfter/RunEvery 定时器
+    void CancelInLoop(uint64_t seq)
     {
-        // 创建一个新的定时器任务对象
-        PtrTask pt(new TimerTask(id, delay, cb));
-        // 设置定时器任务的释放函数
-        pt->SetRelease(std::bind(&TimerWheel::RemoveTimer, this, id));
-        // 计算定时器任务应该放置的位置
-        int pos = (_tick + delay) % _capacity;
-        // 将定时器任务添加到对应的位置
-        _wheel[pos].push_back(pt);
-        // 将定时器任务的弱指针添加到 _timers 映射中
-        _timers[id] = WeakTask(pt);
+        auto it = _loop_timers.find(seq);
+        if (it == _loop_timers.end())
+            return; // 已经执行完或者已经取消
+        LoopTimer *timer = it->second.get();
+        timer->_node.Unlink();
+        // 在自己的回调函数中取消时，等回调函数返回之后再释放
+        if (timer->_running)
+        {
+            timer->_canceled = true;
+            return;
+        }
+        _loop_timers.erase(it);
     }
 
-    // 在事件循环的线程中刷新一个定时器任务
-    void TimerRefreshInLoop(uint64_t id)
+    // RunAfter/RunEvery 定时器到期
+    void OnLoopTimer(uint64_t seq)
     {
-        // 在 _timers 映射中查找指定 ID 的定时器任务
-        auto it = _timers.find(id);
-        if (it == _timers.end())
+        auto it = _loop_timers.find(seq);
+        if (it == _loop_timers.end())
+            return;
+        LoopTimer *timer = it->second.get();
+        if (timer->_interval == 0)
         {
-            return; // 未找到定时器任务，无法刷新
+            // 一次性的定时器先移出映射表再执行，回调函数中取消它是无效操作
+            TaskFunc cb;
+            cb.swap(timer->_task_cb);
+            _loop_timers.erase(it);
+            return cb();
         }
-        // 通过弱指针获取定时器任务的共享指针
-        PtrTask pt = it->second.lock(); 
-        if (!pt) return; // 如果共享指针为空，说明任务已被释放
-        // 获取定时器任务的超时时间
-        int delay = pt->DelayTime();
-        // 计算定时器任务应该放置的新位置
-        int pos = (_tick + delay) % _capacity;
-        // 将定时器任务添加到新的位置
-        _wheel[pos].push_back(pt);
+        // 周期定时器先重新计时：下一次到期时间从本次计划的到期时间算起，而不是从实际执行的时间算起，
+        // 唤醒延迟和执行时间都不会累积到后面的周期上；落后超过一个周期时跳过错过的周期，不连续补执行
+        uint64_t now = _clock->MonotonicMs();
+        uint64_t next = timer->_node._expire + timer->_interval;
+        if (next <= now)
+            next += ((now - next) / timer->_interval + 1) * timer->_interval;
+        timer->_node._timeout = timer->_interval;
+        timer->_node._active = next - timer->_interval;
+        timer->_node._expire = next;
+        Place(&timer->_node);
+        timer->_running = true;
+        timer->_task_cb();
+        timer->_running = false;
+        if (timer->_canceled)
+            _loop_timers.erase(seq);
     }
 
-    // 在事件循环的线程中取消一个定时器任务
-    void TimerCancelInLoop(uint64_t id)
+    // 从一个槽位中摘除所有节点，时间轮销毁时调用
+    static void Clear(TimerNode *&slot)
     {
-        // 在 _timers 映射中查找指定 ID 的定时器任务
-        auto it = _timers.find(id);
-        if (it == _timers.end())
+        while (slot)
         {
-            return; // 未找到定时器任务，无法取消
+            slot->Unlink();
         }
-        // 通过弱指针获取定时器任务的共享指针
-        PtrTask pt = it->second.lock();
-        if (pt)
-            pt->Cancel(); // 取消定时器任务
     }
 
 public:
     // 构造函数，初始化定时器轮的相关信息
-    TimerWheel(EventLoop *loop) 
-        : _capacity(60), _tick(0), _wheel(_capacity), _loop(loop),
-          _timerfd(CreateTimerfd()), _timer_channel(new Channel(_loop, _timerfd))
+    TimerWheel(EventLoop *loop, CachedClock *clock) 
+        : _current(clock->MonotonicMs()), _near(TIMER_NEAR_SIZE, NULL), _levels(TIMER_LEVELS, std::vector<TimerNode *>(TIMER_LEVEL_SIZE, NULL)),
+          _next_seq(0), _slack(TIMER_DEFAULT_SLACK_MS), _armed(UINT64_MAX), _advancing(false), _loop(loop), _clock(clock), _timerfd(CreateTimerfd()), _timer_channel(new Channel(_loop, _timerfd))
     {
         // 设置定时器通道的读事件回调函数为 OnTime
         _timer_channel->SetReadCallback(std::bind(&TimerWheel::OnTime, this));
@@ -201,26 +449,52 @@ public:
         _timer_channel->EnableRead(); 
     }
 
-    // 在事件循环中添加一个定时器任务
-    void TimerAdd(uint64_t id, uint32_t delay, const TaskFunc &cb);
+    // 析构函数，EventLoop 退出时调用；尚未到期的定时任务全部取消，不再执行
+    ~TimerWheel()
+    {
+        for (auto &slot : _near)
+        {
+            Clear(slot);
+        }
+        for (auto &level : _levels)
+        {
+            for (auto &slot : level)
+            {
+                Clear(slot);
+            }
+        }
+        _loop_timers.clear();
+        _timer_channel->Remove();
+        close(_timerfd);
+    }
 
-    // 在事件循环中刷新一个定时器任务
-    void TimerRefresh(uint64_t id);
+    // 当前时间，单调时钟的毫秒数，用作 TimerNode::Touch 的参数
+    // 时间轮只在有定时器到期时推进，_current 可能落后很久，这里使用本轮事件循环缓存的时间，不读取时钟
+    uint64_t Now() { return _clock->MonotonicMs(); }
 
-    // 在事件循环中取消一个定时器任务
-    void TimerCancel(uint64_t id);
+    // 设置定时器合并时间（毫秒），可以在任意线程中调用
+    void SetSlack(uint64_t slack);
 
-    // 检查是否存在指定 ID 的定时器任务
-    //这个接口存在线程安全问题--这个接口实际上不能被外界使用者调用，只能在模块内，在对应的EventLoop线程内执行
-    bool HasTimer(uint64_t id)
+    // 启动一个定时器节点，delay 毫秒之后到期；节点已经在时间轮中时重新计时。只能在 EventLoop 线程中调用
+    void TimerStart(TimerNode *node, uint64_t delay)
     {
-        auto it = _timers.find(id);
-        if (it == _timers.end())
-        {
-            return false; // 未找到定时器任务
-        }
-        return true;
+        node->Unlink();
+        uint64_t now = _clock->MonotonicMs();
+        node->_timeout = delay;
+        node->_active = now;
+        node->_expire = now + delay;
+        Place(node);
     }
-};
 
+    // 停止一个定时器节点，只能在 EventLoop 线程中调用
+    void TimerStop(TimerNode *node) { node->Unlink(); }
 
+    // 添加一个 delay 毫秒之后执行一次的定时任务，可以在任意线程中调用
+    TimerId RunAfter(uint64_t delay, const TaskFunc &cb) { return RunEvery(delay, 0, cb); }
+
+    // 添加一个 delay 毫秒之后开始、每隔 interval 毫秒执行一次的定时任务，interval 为 0 时只执行一次，可以在任意线程中调用
+    TimerId RunEvery(uint64_t delay, uint64_t interval, const TaskFunc &cb);
+
+    // 取消一个定时任务，可以在任意线程中调用；任务已经执行完或者已经取消时什么都不做
+    void Cancel(TimerId id);
+};
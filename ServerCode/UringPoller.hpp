@@ -0,0 +1,656 @@
+#pragma once
+#include "../Log.hpp"
+#include "Channel.hpp"
+#include <vector>
+#include <utility>
+#include <functional>
+#include <cassert>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+// io_uring 提交队列的大小，完成队列由内核设置为它的两倍
+#define URING_ENTRIES 1024
+// 提供给内核的接收缓冲区的数量（必须是 2 的幂）和每块的大小，多次触发的 recv 请求由内核从中挑选缓冲区存放数据
+#define URING_BUF_COUNT 512
+#define URING_BUF_SIZE 16384
+// 接收缓冲区组的编号
+#define URING_BUF_GROUP 0
+
+using namespace log_ns;
+
+// UringPoller 类用 io_uring 实现描述符的事件监控，接口与 Poller 一致
+// 监控请求的添加、修改、移除都只是写入提交队列，在下一次 Poll 时与等待就绪事件合并成一次 io_uring_enter 系统调用，
+// 不再像 epoll 那样每次修改监控事件都要单独调用一次 epoll_ctl
+// 普通描述符使用单次触发的 IORING_OP_POLL_ADD 请求，事件就绪后在下一次 Poll 时重新提交，提交时内核会立即检查一次就绪状态，
+// 因此与 epoll 的水平触发语义相同：连接一次没有读完或者没有写完的数据，下一轮还会再次报告就绪
+// 边缘触发模式的描述符使用多次触发的 poll 请求（IORING_POLL_ADD_MULTI），只在状态变化时报告，不需要重新提交
+// 内核支持时，Channel 可以要求读事件直接由多次触发的操作完成（见 MultishotOp）：
+// 监听套接字提交一次 IORING_OP_ACCEPT（IORING_ACCEPT_MULTISHOT），之后每个新连接都是一个完成事件，不再逐个调用 accept4；
+// 连接提交一次 IORING_OP_RECV（IORING_RECV_MULTISHOT），内核从注册的缓冲区环中挑选缓冲区存放收到的数据，
+// 不再是每次可读都调用一次 recvmsg。这些结果暂存起来，由 Channel 的读事件回调通过 TakeAccepted/TakeReceived 取走
+class UringPoller
+{
+private:
+    // user_data 的最高两位是请求的类型，接着 30 位是描述符，低 32 位是请求的代号
+    enum
+    {
+        OP_POLL = 0,
+        OP_ACCEPT = 1,
+        OP_RECV = 2
+    };
+
+    // 一个描述符的监控信息
+    struct Entry
+    {
+        Channel *_channel; // 描述符对应的 Channel 对象
+        uint32_t _events;  // Channel 要求监控的事件
+        uint32_t _gen;     // 已经提交的 poll 请求的代号
+        bool _armed;       // 是否有尚未完成的 poll 请求
+        bool _queued;      // 是否已经在待提交列表中
+        // 多次触发请求（accept/recv）的代号由两部分组成：高 16 位是描述符被移除的次数，描述符关闭后被新的连接复用时，
+        // 旧连接还没有结束的请求的结果按照它丢弃；低 16 位是同一个 Channel 提交的序号，用于区分当前的请求和已经取消的请求
+        uint16_t _epoch;
+        uint16_t _ms_seq;
+        bool _ms_armed;    // 是否有尚未结束的多次触发请求
+        bool _ms_closed;   // 多次触发的 recv 已经报告了对端关闭或出错，不再重新提交
+        uint32_t _ready;   // 本次 Poll 中收集到的就绪事件，同一个描述符的多个完成事件只报告一次
+        // 多次触发请求已经完成、还没有被取走的结果：accept 为 (新连接描述符或 -errno, -1)，recv 为 (数据长度或 0/-errno, 缓冲区编号)
+        std::vector<std::pair<int, int>> _done;
+
+        Entry() : _channel(NULL), _events(0), _gen(0), _armed(false), _queued(false),
+                  _epoch(0), _ms_seq(0), _ms_armed(false), _ms_closed(false), _ready(0) {}
+
+        // 当前多次触发请求的代号
+        uint32_t MultishotGen() { return ((uint32_t)_epoch << 16) | _ms_seq; }
+    };
+
+    // io_uring 实例的文件描述符
+    int _ring_fd;
+    // 提交队列和完成队列的映射内存
+    void *_sq_ptr;
+    size_t _sq_size;
+    void *_cq_ptr;
+    size_t _cq_size;
+    struct io_uring_sqe *_sqes;
+    size_t _sqes_size;
+    // 提交队列的各个字段
+    unsigned *_sq_head;
+    unsigned *_sq_tail;
+    unsigned *_sq_mask;
+    unsigned *_sq_array;
+    unsigned _sq_entries;
+    // 完成队列的各个字段
+    unsigned *_cq_head;
+    unsigned *_cq_tail;
+    unsigned *_cq_mask;
+    struct io_uring_cqe *_cqes;
+    // 已经写入提交队列但还没有提交给内核的请求数量
+    unsigned _to_submit;
+    // 下一个 poll 请求的代号，0 保留给不需要处理完成事件的请求
+    uint32_t _next_gen;
+    // 以描述符为下标的监控信息表，_channel 为空表示该描述符没有添加监控
+    std::vector<Entry> _entries;
+    // 等待提交请求的描述符
+    std::vector<int> _arm_list;
+    // 等待取消的请求的 user_data
+    std::vector<uint64_t> _cancel_list;
+    // 本次 Poll 中有就绪事件的描述符
+    std::vector<int> _ready_list;
+    // 注册给内核的接收缓冲区环，以及所有接收缓冲区所在的内存
+    // 缓冲区环直接按 io_uring_buf 数组访问：头文件中 io_uring_buf_ring 的柔性数组在 C++ 下会多出一个空结构体成员，偏移不是 0
+    struct io_uring_buf *_buf_ring;
+    char *_buf_base;
+    // 缓冲区环的尾部，归还缓冲区时移动它
+    uint16_t _buf_tail;
+    // 内核是否支持多次触发的 accept/recv 以及接收缓冲区环
+    bool _multishot;
+
+private:
+    static int Setup(unsigned entries, struct io_uring_params *p)
+    {
+        return (int)syscall(__NR_io_uring_setup, entries, p);
+    }
+
+    int Enter(unsigned to_submit, unsigned min_complete, unsigned flags)
+    {
+        return (int)syscall(__NR_io_uring_enter, _ring_fd, to_submit, min_complete, flags, NULL, 0);
+    }
+
+    static uint64_t UserData(int kind, int fd, uint32_t gen)
+    {
+        return ((uint64_t)kind << 62) | ((uint64_t)(uint32_t)fd << 32) | gen;
+    }
+
+    // 把已经写入提交队列的请求提交给内核，min_complete 大于 0 时同时等待至少这么多个完成事件
+    bool Submit(unsigned min_complete)
+    {
+        unsigned flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+        int ret = Enter(_to_submit, min_complete, flags);
+        if (ret < 0)
+        {
+            // 被信号打断，或者完成队列暂时溢出需要先收割，下次再提交
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+                return false;
+            LOG(ERROR, "IO_URING ENTER ERROR:%s\n", strerror(errno));
+            abort();
+        }
+        _to_submit -= ret < (int)_to_submit ? ret : _to_submit;
+        return true;
+    }
+
+    // 从提交队列中取一个空闲的请求项，提交队列满了就先把已有的请求提交给内核
+    struct io_uring_sqe *GetSqe()
+    {
+        while (1)
+        {
+            unsigned head = __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+            unsigned tail = *_sq_tail;
+            if (tail - head < _sq_entries)
+            {
+                unsigned idx = tail & *_sq_mask;
+                struct io_uring_sqe *sqe = &_sqes[idx];
+                memset(sqe, 0, sizeof(*sqe));
+                _sq_array[idx] = idx;
+                return sqe;
+            }
+            Submit(0);
+        }
+    }
+
+    // 请求项填写完毕，移动提交队列尾部，让内核可以看到它
+    void PushSqe()
+    {
+        __atomic_store_n(_sq_tail, *_sq_tail + 1, __ATOMIC_RELEASE);
+        _to_submit++;
+    }
+
+    // 描述符是否使用多次触发的操作完成读事件
+    bool WantMultishot(Channel *channel, uint32_t events)
+    {
+        return _multishot && channel->Multishot() != MULTISHOT_NONE && (events & EPOLLIN);
+    }
+
+    // 描述符是否需要 poll 请求：多次触发接收模式下可读由 recv 请求报告，poll 请求只监控可写，
+    // 没有监控可写时也保留一个，接收与 epoll 一样始终报告的错误（例如零拷贝完成通知）和挂断事件
+    bool WantPoll(Channel *channel, uint32_t events)
+    {
+        if ((events & (EPOLLIN | EPOLLOUT)) == 0)
+            return false;
+        if (WantMultishot(channel, events) && channel->Multishot() == MULTISHOT_ACCEPT)
+            return (events & EPOLLOUT) != 0;
+        return true;
+    }
+
+    // poll 请求要监控的事件
+    uint32_t PollEvents(Channel *channel, uint32_t events)
+    {
+        return WantMultishot(channel, events) ? (events & ~EPOLLIN) : events;
+    }
+
+    // 把待取消和待提交的请求写入提交队列
+    void Flush()
+    {
+        for (auto ud : _cancel_list)
+        {
+            struct io_uring_sqe *sqe = GetSqe();
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = -1;
+            sqe->addr = ud;
+            sqe->user_data = 0;
+            PushSqe();
+        }
+        _cancel_list.clear();
+        for (auto fd : _arm_list)
+        {
+            Entry &entry = _entries[fd];
+            entry._queued = false;
+            Channel *channel = entry._channel;
+            if (channel == NULL)
+                continue;
+            if (entry._ms_armed == false && entry._ms_closed == false && WantMultishot(channel, entry._events))
+            {
+                entry._ms_seq++;
+                entry._ms_armed = true;
+                struct io_uring_sqe *sqe = GetSqe();
+                sqe->fd = fd;
+                if (channel->Multishot() == MULTISHOT_ACCEPT)
+                {
+                    sqe->opcode = IORING_OP_ACCEPT;
+                    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+                    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+                    sqe->user_data = UserData(OP_ACCEPT, fd, entry.MultishotGen());
+                }
+                else
+                {
+                    // 不指定缓冲区，由内核在收到数据时从缓冲区组中挑选一块
+                    sqe->opcode = IORING_OP_RECV;
+                    sqe->flags = IOSQE_BUFFER_SELECT;
+                    sqe->buf_group = URING_BUF_GROUP;
+                    sqe->ioprio = IORING_RECV_MULTISHOT;
+                    sqe->user_data = UserData(OP_RECV, fd, entry.MultishotGen());
+                }
+                PushSqe();
+            }
+            if (entry._armed == false && WantPoll(channel, entry._events))
+            {
+                uint32_t events = PollEvents(channel, entry._events);
+                if (++_next_gen == 0)
+                    _next_gen = 1;
+                entry._gen = _next_gen;
+                entry._armed = true;
+                struct io_uring_sqe *sqe = GetSqe();
+                sqe->opcode = IORING_OP_POLL_ADD;
+                sqe->fd = fd;
+                sqe->poll32_events = events & ~EPOLLET;
+                if (events & EPOLLET)
+                    sqe->len = IORING_POLL_ADD_MULTI;
+                sqe->user_data = UserData(OP_POLL, fd, entry._gen);
+                PushSqe();
+            }
+        }
+        _arm_list.clear();
+    }
+
+    // 把描述符加入待提交列表
+    void Queue(int fd, Entry &entry)
+    {
+        if (entry._queued)
+            return;
+        entry._queued = true;
+        _arm_list.push_back(fd);
+    }
+
+    // 取消描述符已经提交的 poll 请求
+    void Cancel(int fd, Entry &entry)
+    {
+        if (entry._armed == false)
+            return;
+        entry._armed = false;
+        _cancel_list.push_back(UserData(OP_POLL, fd, entry._gen));
+    }
+
+    // 取消描述符已经提交的多次触发请求，取消之前已经完成的结果仍然会交给 Channel
+    void CancelMultishot(int fd, Entry &entry)
+    {
+        if (entry._ms_armed == false)
+            return;
+        entry._ms_armed = false;
+        int kind = entry._channel->Multishot() == MULTISHOT_ACCEPT ? OP_ACCEPT : OP_RECV;
+        _cancel_list.push_back(UserData(kind, fd, entry.MultishotGen()));
+    }
+
+    // 把一块接收缓冲区归还到缓冲区环中，内核可以再次使用它
+    void RecycleBuffer(int bid)
+    {
+        struct io_uring_buf *buf = &_buf_ring[_buf_tail & (URING_BUF_COUNT - 1)];
+        buf->addr = (uint64_t)(uintptr_t)(_buf_base + (size_t)bid * URING_BUF_SIZE);
+        buf->len = URING_BUF_SIZE;
+        buf->bid = bid;
+        _buf_tail++;
+        // 环的尾部与第一项的 resv 字段重叠
+        __atomic_store_n(&_buf_ring[0].resv, _buf_tail, __ATOMIC_RELEASE);
+    }
+
+    // 丢弃没有人取走的多次触发结果：归还接收缓冲区，关闭接受的新连接
+    void DropResult(int kind, int res, int bid)
+    {
+        if (bid >= 0)
+            RecycleBuffer(bid);
+        if (kind == OP_ACCEPT && res >= 0)
+            close(res);
+    }
+
+    // 记录描述符在本次 Poll 中的就绪事件
+    void MarkReady(int fd, Entry &entry, uint32_t events)
+    {
+        if (entry._ready == 0)
+            _ready_list.push_back(fd);
+        entry._ready |= events;
+    }
+
+    // 处理多次触发的 accept/recv 请求的完成事件
+    void HandleMultishot(int kind, int fd, uint32_t gen, struct io_uring_cqe *cqe)
+    {
+        int res = cqe->res;
+        int bid = (cqe->flags & IORING_CQE_F_BUFFER) ? (int)(cqe->flags >> IORING_CQE_BUFFER_SHIFT) : -1;
+        // 描述符已经移除，或者关闭后被新的连接复用了，结果属于旧的 Channel，直接丢弃
+        if (fd >= (int)_entries.size() || _entries[fd]._channel == NULL || (uint16_t)(gen >> 16) != _entries[fd]._epoch)
+            return DropResult(kind, res, bid);
+        Entry &entry = _entries[fd];
+        if ((cqe->flags & IORING_CQE_F_MORE) == 0 && entry._ms_armed && entry.MultishotGen() == gen)
+        {
+            // 请求已经结束（例如缓冲区环暂时用完了），下一次 Poll 时重新提交
+            entry._ms_armed = false;
+            Queue(fd, entry);
+        }
+        if (res == -ECANCELED || res == -ENOBUFS)
+            return;
+        if (kind == OP_RECV && res <= 0)
+        {
+            // 对端关闭或者出错，与 recv 返回 0 的处理相同，不再重新提交
+            entry._ms_closed = true;
+        }
+        entry._done.push_back(std::make_pair(res, bid));
+        MarkReady(fd, entry, EPOLLIN);
+    }
+
+    // 注册接收缓冲区环，并用一个 socketpair 试探内核是否支持多次触发的 recv（6.0 以上），不支持时返回 false
+    bool InitMultishot()
+    {
+        size_t ring_size = URING_BUF_COUNT * sizeof(struct io_uring_buf);
+        void *ring = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        void *base = mmap(NULL, (size_t)URING_BUF_COUNT * URING_BUF_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ring == MAP_FAILED || base == MAP_FAILED)
+        {
+            if (ring != MAP_FAILED)
+                munmap(ring, ring_size);
+            if (base != MAP_FAILED)
+                munmap(base, (size_t)URING_BUF_COUNT * URING_BUF_SIZE);
+            return false;
+        }
+        _buf_ring = (struct io_uring_buf *)ring;
+        _buf_base = (char *)base;
+        struct io_uring_buf_reg reg;
+        memset(&reg, 0, sizeof(reg));
+        reg.ring_addr = (uint64_t)(uintptr_t)ring;
+        reg.ring_entries = URING_BUF_COUNT;
+        reg.bgid = URING_BUF_GROUP;
+        if (syscall(__NR_io_uring_register, _ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+            return false;
+        for (int i = 0; i < URING_BUF_COUNT; i++)
+            RecycleBuffer(i);
+        // 一端写入一个字节后关闭写方向，支持时先得到带 IORING_CQE_F_MORE 的数据，再得到结束请求的 0
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0)
+            return false;
+        bool ok = false;
+        if (write(sv[1], "x", 1) == 1 && shutdown(sv[1], SHUT_WR) == 0)
+        {
+            struct io_uring_sqe *sqe = GetSqe();
+            sqe->opcode = IORING_OP_RECV;
+            sqe->fd = sv[0];
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = URING_BUF_GROUP;
+            sqe->ioprio = IORING_RECV_MULTISHOT;
+            PushSqe();
+            bool more = true;
+            while (more)
+            {
+                if (Submit(1) == false)
+                    continue;
+                unsigned head = *_cq_head;
+                unsigned tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+                for (; head != tail; head++)
+                {
+                    struct io_uring_cqe *cqe = &_cqes[head & *_cq_mask];
+                    if (cqe->flags & IORING_CQE_F_BUFFER)
+                        RecycleBuffer(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+                    if (cqe->res > 0 && (cqe->flags & IORING_CQE_F_MORE))
+                        ok = true;
+                    if ((cqe->flags & IORING_CQE_F_MORE) == 0)
+                        more = false;
+                }
+                __atomic_store_n(_cq_head, tail, __ATOMIC_RELEASE);
+            }
+        }
+        close(sv[0]);
+        close(sv[1]);
+        return ok;
+    }
+
+    // 释放映射的内存和 io_uring 实例
+    void Destroy()
+    {
+        if (_sqes)
+            munmap(_sqes, _sqes_size);
+        if (_cq_ptr && _cq_ptr != _sq_ptr)
+            munmap(_cq_ptr, _cq_size);
+        if (_sq_ptr)
+            munmap(_sq_ptr, _sq_size);
+        if (_ring_fd >= 0)
+            close(_ring_fd);
+        // 缓冲区环的内存被内核固定，关闭 io_uring 实例之后再释放
+        if (_buf_ring)
+            munmap(_buf_ring, URING_BUF_COUNT * sizeof(struct io_uring_buf));
+        if (_buf_base)
+            munmap(_buf_base, (size_t)URING_BUF_COUNT * URING_BUF_SIZE);
+        _sqes = NULL;
+        _cq_ptr = _sq_ptr = NULL;
+        _ring_fd = -1;
+        _buf_ring = NULL;
+        _buf_base = NULL;
+    }
+
+    // 创建 io_uring 实例并映射提交队列和完成队列，内核不支持或者被禁用时返回 false
+    bool Init()
+    {
+        struct io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        _ring_fd = Setup(URING_ENTRIES, &p);
+        if (_ring_fd < 0)
+        {
+            LOG(WARNING, "IO_URING SETUP FAILED:%s\n", strerror(errno));
+            return false;
+        }
+        _sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        _cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+        // 内核支持单次映射时提交队列和完成队列共用一块内存
+        if (p.features & IORING_FEAT_SINGLE_MMAP)
+        {
+            if (_cq_size > _sq_size)
+                _sq_size = _cq_size;
+            _cq_size = _sq_size;
+        }
+        _sq_ptr = mmap(NULL, _sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_SQ_RING);
+        if (_sq_ptr == MAP_FAILED)
+        {
+            _sq_ptr = NULL;
+            return false;
+        }
+        if (p.features & IORING_FEAT_SINGLE_MMAP)
+        {
+            _cq_ptr = _sq_ptr;
+        }
+        else
+        {
+            _cq_ptr = mmap(NULL, _cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_CQ_RING);
+            if (_cq_ptr == MAP_FAILED)
+            {
+                _cq_ptr = NULL;
+                return false;
+            }
+        }
+        _sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+        _sqes = (struct io_uring_sqe *)mmap(NULL, _sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_SQES);
+        if (_sqes == MAP_FAILED)
+        {
+            _sqes = NULL;
+            return false;
+        }
+        char *sq = (char *)_sq_ptr;
+        _sq_head = (unsigned *)(sq + p.sq_off.head);
+        _sq_tail = (unsigned *)(sq + p.sq_off.tail);
+        _sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+        _sq_array = (unsigned *)(sq + p.sq_off.array);
+        _sq_entries = p.sq_entries;
+        char *cq = (char *)_cq_ptr;
+        _cq_head = (unsigned *)(cq + p.cq_off.head);
+        _cq_tail = (unsigned *)(cq + p.cq_off.tail);
+        _cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+        _cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+        // 多次触发的操作不可用时，读事件仍然使用 poll 请求
+        _multishot = InitMultishot();
+        if (_multishot == false)
+            LOG(WARNING, "IO_URING MULTISHOT RECV UNAVAILABLE, USE POLL ONLY\n");
+        return true;
+    }
+
+    UringPoller() : _ring_fd(-1), _sq_ptr(NULL), _sq_size(0), _cq_ptr(NULL), _cq_size(0), _sqes(NULL), _sqes_size(0),
+                    _sq_head(NULL), _sq_tail(NULL), _sq_mask(NULL), _sq_array(NULL), _sq_entries(0),
+                    _cq_head(NULL), _cq_tail(NULL), _cq_mask(NULL), _cqes(NULL), _to_submit(0), _next_gen(0),
+                    _buf_ring(NULL), _buf_base(NULL), _buf_tail(0), _multishot(false) {}
+
+public:
+    // 创建一个 io_uring 事件监控对象，内核不支持时返回 NULL，由调用者退回到 epoll
+    static UringPoller *Create()
+    {
+        UringPoller *poller = new UringPoller();
+        if (poller->Init() == false)
+        {
+            delete poller;
+            return NULL;
+        }
+        return poller;
+    }
+
+    ~UringPoller() { Destroy(); }
+
+    // 是否支持多次触发的 accept/recv，不支持时 Channel 的多次触发设置不起作用
+    bool SupportsMultishot() { return _multishot; }
+
+    // 添加或修改监控事件，只记录下来，在下一次 Poll 时统一提交
+    void UpdateEvent(Channel *channel)
+    {
+        int fd = channel->Fd();
+        if (fd >= (int)_entries.size())
+        {
+            _entries.resize(fd + 1);
+        }
+        Entry &entry = _entries[fd];
+        entry._channel = channel;
+        uint32_t events = channel->Events();
+        if (entry._events != events)
+        {
+            // poll 请求监控的事件发生了变化，取消旧的请求，重新提交
+            if (PollEvents(channel, entry._events) != PollEvents(channel, events) || WantPoll(channel, events) == false)
+                Cancel(fd, entry);
+            // 不再需要读事件（例如暂停读），取消多次触发的请求，已经收到的数据仍然会交给 Channel
+            if (WantMultishot(channel, events) == false)
+                CancelMultishot(fd, entry);
+            entry._events = events;
+        }
+        // 请求已经提交时在 Flush 中会跳过
+        Queue(fd, entry);
+    }
+
+    // 移除监控，取消已经提交的请求
+    void RemoveEvent(Channel *channel)
+    {
+        int fd = channel->Fd();
+        if (fd >= (int)_entries.size() || _entries[fd]._channel == NULL)
+            return;
+        Entry &entry = _entries[fd];
+        Cancel(fd, entry);
+        CancelMultishot(fd, entry);
+        int kind = channel->Multishot() == MULTISHOT_ACCEPT ? OP_ACCEPT : OP_RECV;
+        for (auto &done : entry._done)
+        {
+            DropResult(kind, done.first, done.second);
+        }
+        entry._done.clear();
+        // 描述符可能还在待提交列表中，保留 _queued 标志，提交时会跳过已经移除的描述符
+        entry._channel = NULL;
+        entry._events = 0;
+        entry._ms_closed = false;
+        // 之后才到达的旧请求的完成事件按照代号丢弃，描述符被复用后不会交给新的 Channel
+        entry._epoch++;
+    }
+
+    // 取走多次触发 accept 接受的新连接，返回接受过程中遇到的错误码（例如 EMFILE），没有错误返回 0
+    int TakeAccepted(Channel *channel, std::vector<int> *fds)
+    {
+        Entry &entry = _entries[channel->Fd()];
+        int err = 0;
+        for (auto &done : entry._done)
+        {
+            if (done.first >= 0)
+                fds->push_back(done.first);
+            else if (err == 0)
+                err = -done.first;
+        }
+        entry._done.clear();
+        return err;
+    }
+
+    // 取走多次触发 recv 收到的数据，依次交给 cb 处理后立即归还接收缓冲区
+    // 返回值：大于等于 0 为取走的数据量，-1 表示对端已经关闭连接或者出错（之前收到的数据已经交给了 cb）
+    ssize_t TakeReceived(Channel *channel, const std::function<void(const char *, size_t)> &cb)
+    {
+        Entry &entry = _entries[channel->Fd()];
+        ssize_t total = 0;
+        bool closed = false;
+        for (auto &done : entry._done)
+        {
+            if (done.first > 0)
+            {
+                cb(_buf_base + (size_t)done.second * URING_BUF_SIZE, done.first);
+                total += done.first;
+            }
+            else
+            {
+                closed = true;
+            }
+            if (done.second >= 0)
+                RecycleBuffer(done.second);
+        }
+        entry._done.clear();
+        return closed ? -1 : total;
+    }
+
+    // 提交所有积累的请求并等待事件就绪，返回活跃连接，nowait 为 true 时只提交请求、收割已有的完成事件，不等待
+    void Poll(std::vector<Channel *> *active, bool nowait = false)
+    {
+        Flush();
+        // 完成队列中已经有事件时不再等待，只提交请求
+        unsigned ready = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE) - *_cq_head;
+        if (nowait == false || _to_submit > 0)
+            Submit(ready > 0 || nowait ? 0 : 1);
+        unsigned head = *_cq_head;
+        unsigned tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++)
+        {
+            struct io_uring_cqe *cqe = &_cqes[head & *_cq_mask];
+            uint64_t ud = cqe->user_data;
+            // 取消请求本身的完成事件不需要处理
+            if (ud == 0)
+                continue;
+            int kind = (int)(ud >> 62);
+            int fd = (int)((ud >> 32) & 0x3fffffff);
+            uint32_t gen = (uint32_t)ud;
+            if (kind != OP_POLL)
+            {
+                HandleMultishot(kind, fd, gen, cqe);
+                continue;
+            }
+            int res = cqe->res;
+            // 被取消的请求，描述符已经移除，或者是修改监控事件之前提交的旧请求，都不需要处理
+            if (res == -ECANCELED || fd >= (int)_entries.size())
+                continue;
+            Entry &entry = _entries[fd];
+            if (entry._channel == NULL || entry._armed == false || entry._gen != gen)
+                continue;
+            if ((cqe->flags & IORING_CQE_F_MORE) == 0)
+            {
+                // 单次触发的请求已经完成，或者多次触发的请求被内核终止，下一次 Poll 时重新提交
+                entry._armed = false;
+                Queue(fd, entry);
+            }
+            MarkReady(fd, entry, res < 0 ? EPOLLERR : (uint32_t)res);
+        }
+        __atomic_store_n(_cq_head, tail, __ATOMIC_RELEASE);
+        for (auto fd : _ready_list)
+        {
+            Entry &entry = _entries[fd];
+            if (entry._channel)
+            {
+                entry._channel->SetREvents(entry._ready);
+                active->push_back(entry._channel);
+            }
+            entry._ready = 0;
+        }
+        _ready_list.clear();
+    }
+};
@@ -7,6 +7,8 @@
           这时候一旦345描述符对应的连接被释放，接下来在处理345事件的时候就会导致程序崩溃（内存访问错误）
           因此这时候，在本次事件处理中，并不能直接对连接进行释放，而应该将释放操作压入到任务池中，
           等到事件处理完了执行任务池中的任务的时候，再去释放
+     2. 耗时的业务处理可以在注册路由时指定offload，并设置计算线程数量（SetComputeThreads），
+        处理函数在计算线程池中执行，处理完之后再回到连接所属的线程发送响应，处理连接的线程不会被阻塞
 */
 #include "../ServerModules/TcpServer.hpp"
 #include<signal.h>
@@ -0,0 +1,95 @@
+/*大文件下载测试，从服务器请求一个大的静态资源文件，观察服务器的内存占用以及接收到的数据*/
+/*
+    服务器通过sendfile直接发送文件数据，不会把文件读入内存，服务器的内存占用不随文件大小增长
+    响应状态码为200，接收到的正文长度和Content-Length一致，正文内容和服务器上的文件逐字节一致
+    测试文件 ProtocolCode/wwwroot/big.bin 不在仓库中，不存在时由本程序生成（64MB），也可以手动生成：
+        head -c 64M /dev/urandom > ProtocolCode/wwwroot/big.bin
+    在 test 目录下运行本程序，服务器在 ProtocolCode 目录下运行
+*/
+#include "../ServerCode/TcpServer.hpp"
+#include <fstream>
+
+#define BIG_FILE "../ProtocolCode/wwwroot/big.bin"
+#define BIG_FILE_SIZE (64 * 1024 * 1024)
+
+// 测试文件不存在时生成一个，内容是伪随机数据，避免全零数据掩盖错位、重复发送等问题
+static void PrepareBigFile()
+{
+    std::ifstream exist(BIG_FILE, std::ios::binary);
+    if (exist.good())
+    {
+        return;
+    }
+    std::ofstream ofs(BIG_FILE, std::ios::binary);
+    assert(ofs.good());
+    std::vector<char> block(65536);
+    uint32_t seed = 0x12345678;
+    for (size_t written = 0; written < BIG_FILE_SIZE; written += block.size())
+    {
+        for (auto &ch : block)
+        {
+            seed = seed * 1103515245 + 12345;
+            ch = (char)(seed >> 16);
+        }
+        ofs.write(&block[0], block.size());
+    }
+    assert(ofs.good());
+    ofs.close();
+    // 等待服务器文件缓存中该路径"不存在"的记录过期
+    sleep(2);
+}
+
+int main()
+{
+    PrepareBigFile();
+    std::ifstream file(BIG_FILE, std::ios::binary);
+    assert(file.good());
+    file.seekg(0, std::ios::end);
+    size_t fsize = file.tellg();
+    file.seekg(0, std::ios::beg);
+
+    Socket cli_sock;
+    cli_sock.CreateClient(8888, "127.0.0.1");
+    std::string req = "GET /big.bin HTTP/1.1\r\nConnection: keep-alive\r\nContent-Length: 0\r\n\r\n";
+    assert(cli_sock.Send(req.c_str(), req.size()) != -1);
+    // 先接收响应头部，检查状态码，找到Content-Length
+    std::string rsp;
+    size_t pos = std::string::npos;
+    while (pos == std::string::npos) {
+        char buf[4096] = {0};
+        ssize_t ret = cli_sock.Recv(buf, 4096);
+        assert(ret > 0);
+        rsp.append(buf, ret);
+        pos = rsp.find("\r\n\r\n");
+    }
+    LOG(DEBUG, "[%s]\n", rsp.substr(0, pos).c_str());
+    assert(rsp.compare(0, 13, "HTTP/1.1 200 ") == 0);
+    size_t clen_pos = rsp.find("Content-Length: ");
+    assert(clen_pos != std::string::npos && clen_pos < pos);
+    size_t clen = std::stol(rsp.substr(clen_pos + 16));
+    assert(clen == fsize);
+    // 再接收完整的正文，边接收边和本地文件的内容比较
+    std::string body = rsp.substr(pos + 4);
+    size_t recvd = 0;
+    std::vector<char> expect;
+    while (true) {
+        if (body.empty() == false) {
+            assert(recvd + body.size() <= clen);
+            expect.resize(body.size());
+            file.read(&expect[0], expect.size());
+            assert(file.gcount() == (std::streamsize)expect.size());
+            assert(memcmp(&expect[0], body.data(), body.size()) == 0);
+            recvd += body.size();
+        }
+        if (recvd >= clen) {
+            break;
+        }
+        char buf[65536];
+        ssize_t ret = cli_sock.Recv(buf, 65536);
+        assert(ret > 0);
+        body.assign(buf, ret);
+    }
+    LOG(DEBUG, "RECV BODY %lu/%lu BYTES, CONTENT MATCHED\n", recvd, clen);
+    cli_sock.Close();
+    return 0;
+}
@@ -0,0 +1,23 @@
+/*慢速消费者测试，一次性给服务器发送大量请求，但是不接收响应，观察服务器的内存占用*/
+/*
+    服务器设置了输出高水位线后，待发送的响应超过高水位线就暂停读取和处理后续请求，内存占用不会无限增长
+    服务器设置了写停滞超时后，客户端长时间不接收数据，服务器会主动释放连接
+*/
+#include "../ServerCode/TcpServer.hpp"
+
+int main()
+{
+    Socket cli_sock;
+    cli_sock.CreateClient(8888, "127.0.0.1");
+    std::string req = "GET /index.html HTTP/1.1\r\nConnection: keep-alive\r\nContent-Length: 0\r\n\r\n";
+    std::string reqs;
+    for (int i = 0; i < 10000; i++) {
+        reqs += req;
+    }
+    // 只管发送，不接收响应，发送缓冲区满了之后就阻塞在这里
+    assert(cli_sock.Send(reqs.c_str(), reqs.size()) != -1);
+    LOG(DEBUG, "SEND %lu REQUESTS, NOW SLEEP\n", 10000UL);
+    sleep(60);
+    cli_sock.Close();
+    return 0;
+}
@@ -0,0 +1,38 @@
+/*计算线程池测试，请求一个交给计算线程池处理的耗时接口，发送完请求之后立即关闭写方向（半关闭），观察响应*/
+/*
+    服务器在计算线程池中处理请求期间，对端已经半关闭连接，处理完之后响应仍然完整地发送回来，然后服务器关闭连接
+    同一个连接上连续发送的两个请求，响应按照请求的顺序返回
+*/
+#include "../ServerCode/TcpServer.hpp"
+
+int main()
+{
+    Socket cli_sock;
+    cli_sock.CreateClient(8888, "127.0.0.1");
+    std::string req = "GET /slow?seq=1 HTTP/1.1\r\nConnection: keep-alive\r\nContent-Length: 0\r\n\r\n";
+    req += "GET /slow?seq=2 HTTP/1.1\r\nConnection: keep-alive\r\nContent-Length: 0\r\n\r\n";
+    assert(cli_sock.Send(req.c_str(), req.size()) != -1);
+    // 请求发送完就关闭写方向，服务器读到 EOF 时两个请求都还没有处理完
+    shutdown(cli_sock.Fd(), SHUT_WR);
+    // 一直接收到服务器关闭连接为止
+    std::string rsp;
+    char buf[4096];
+    while (1) {
+        ssize_t ret = recv(cli_sock.Fd(), buf, sizeof(buf), 0);
+        if (ret <= 0) break;
+        rsp.append(buf, ret);
+    }
+    LOG(DEBUG, "[%s]\n", rsp.c_str());
+    // 两个响应都是 200，并且按照请求的顺序
+    int count = 0;
+    for (size_t pos = rsp.find("HTTP/1.1 200"); pos != std::string::npos; pos = rsp.find("HTTP/1.1 200", pos + 1)) {
+        count++;
+    }
+    assert(count == 2);
+    size_t first = rsp.find("seq: 1");
+    size_t second = rsp.find("seq: 2");
+    assert(first != std::string::npos && second != std::string::npos && first < second);
+    LOG(DEBUG, "OFFLOAD TEST PASSED\n");
+    cli_sock.Close();
+    return 0;
+}